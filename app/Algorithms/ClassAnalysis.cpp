@@ -18,13 +18,19 @@
 */
 
 #include "ClassAnalysis.h"
+#include <Parallel.h>
 
 #include <cstring>
 #include <cstdio>
 #include <cmath>
 #include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <atomic>
+#include <limits>
 
 #include "GrayscaleImage.h"
+#include <Converter.h>
 
 using namespace ClassAnalysis;
 using namespace imagein;
@@ -34,74 +40,53 @@ void ClassAnalysis::analyse(int fen, uint8_t *imorig, double *param1, double *pa
 
     // Param 1: Will now hold the means
     // Param 2: Will now hold the standard deviations
-    if(!( fen < (nbl * 2) && fen < (nbc * 2) )) {
-        char buffer[255];
-        sprintf( buffer, "Error in ClassAnalysis::analyse:\nfen = %d, nbl = %d, nbc = %d\n", fen, nbl, nbc );
-        throw buffer;
-    }
-//	char nom1[40],nom2[40];
-    int fen2,i,j,k,l,nbp;
-    long indexy;
-    long indexx;
-    double moy,sigma;
-
-//	printf("taille de la fenetre locale pour le calcul des parametres :");
-//	scanf("%d",&fen);
     if(fen < 3) fen=3;
-    if(fen > 15) fen=15;
-    fen2 = fen/2;
-//	printf("nom de l'image du parametre 1 :");
-//	scanf("%s",nom1);
-//	printf("nom de l'image du parametre 2 :");
-//	scanf("%s",nom2);
-
-    nbp = fen*fen;
-    for(i=0 ; i<nbl ; i++)
-      for(j=0 ; j<nbc ; j++)
-      {
-         moy = sigma = 0;
-
-         for(k=-fen2 ; k<fen2+1 ; k++)
-            for(l=-fen2 ; l<fen2+1 ; l++)
-     {
-              indexy = abs((i+k));
-                if( indexy >= nbl ) {
-                  indexy = 2 * nbl - indexy - 2;
-                }
-                indexx = abs((j+l));
-                if( indexx >= nbc ) {
-                  indexx = 2 * nbc - indexx - 2;
-                }
-                moy = moy + *(imorig+(indexy)*nbc+indexx);
-              sigma = sigma+(*(imorig+(indexy)*nbc+indexx)*(*(imorig+(indexy)*nbc+indexx)));
-     }
-         *(param1+i*nbc+j) = (moy / nbp);
-         *(param2+i*nbc+j) = sqrt((double)(sigma/nbp-(moy*moy)/(nbp*nbp)));
-      }
-
-
-    /*
-        *learning_result_1 = new ImageFloat;
-    (*learning_result_1)->Create( nbc, nbl );
-    *learning_result_2 = new ImageFloat;
-    (*learning_result_2)->Create( nbc, nbl );
-    (*learning_result_1)->setFloatMatrix( param1 );
-    (*learning_result_2)->setFloatMatrix( param2 );
-        */
-    //ecrire_image(p1,nom1,nbc,nbl);
-    //ecrire_image(p2,nom2,nbc,nbl);
+    if(!( fen < (nbl * 2) && fen < (nbc * 2) )) {
+        throw "Error in ClassAnalysis::analyse:\nthe window is larger than the image";
+    }
+    const int fen2 = fen/2;
+    const int nbp = fen*fen;
+
+    // Sommes et sommes des carres sur l'image prolongee par symetrie de fen2 pixels
+    // de chaque cote : chaque fenetre coute 4 lectures quelle que soit sa taille.
+    auto miroir = [](int i, int n) {
+        i = abs(i);
+        return i >= n ? 2 * n - i - 2 : i;
+    };
+    const TableSommes<int64_t> sommes(nbc + 2 * fen2, nbl + 2 * fen2, [&](int x, int y) {
+        return (int64_t)imorig[miroir(y - fen2, nbl) * nbc + miroir(x - fen2, nbc)];
+    });
+    const TableSommes<int64_t> carres(nbc + 2 * fen2, nbl + 2 * fen2, [&](int x, int y) {
+        const int64_t v = imorig[miroir(y - fen2, nbl) * nbc + miroir(x - fen2, nbc)];
+        return v * v;
+    });
 
+    Parallel::forBands(0, nbl, [&](int debut, int fin) {
+        for(int i = debut; i < fin; i++) {
+            for(int j = 0; j < nbc; j++) {
+                const double moy = (double)sommes.somme(j, i, j + fen, i + fen);
+                const double sigma = (double)carres.somme(j, i, j + fen, i + fen);
+                param1[i*nbc+j] = (moy / nbp);
+                param2[i*nbc+j] = sqrt((double)(sigma/nbp-(moy*moy)/((double)nbp*nbp)));
+            }
+        }
+    });
 }
 
 void ClassAnalysis::estimateur(double *param1,double *param2,double moy1[],double var1[],double moy2[],double var2[],int fen,int nbl,int nbc, const vector<Rectangle>& rectangles) {
     long nbp;
-    //long fen2;
     double m1,s1,m2,s2;
     int current_rectangle;
     Rectangle rect;
 
+    // Tables des sommes des parametres et de leurs carres : la statistique de
+    // chaque rectangle est obtenue en 4 lectures par table.
+    const TableSommes<double> t1(nbc, nbl, [=](int x, int y) { return param1[y*nbc+x]; });
+    const TableSommes<double> tc1(nbc, nbl, [=](int x, int y) { return param1[y*nbc+x] * param1[y*nbc+x]; });
+    const TableSommes<double> t2(nbc, nbl, [=](int x, int y) { return param2[y*nbc+x]; });
+    const TableSommes<double> tc2(nbc, nbl, [=](int x, int y) { return param2[y*nbc+x] * param2[y*nbc+x]; });
 
-/* estimation des paramtres de chaque classe */
+/* estimation des parametres de chaque classe */
 // Each class is a rectangle in the parameter rectangles
     vector<Rectangle>::const_iterator iter;
     current_rectangle = 0;
@@ -109,15 +94,10 @@ void ClassAnalysis::estimateur(double *param1,double *param2,double moy1[],doubl
         rect = *iter;
         NormalizeRectangle( rect );
         nbp = ((rect.bottom() - rect.top()) + 1) * ((rect.right() - rect.left()) + 1);
-        m1 =  m2 = s1 = s2 = 0;
-        for(unsigned int i=rect.top() ; i<=rect.bottom() ; i++) {
-          for(unsigned int j=rect.left() ; j<=rect.right() ; j++) {
-                m1 = m1 + *(param1+i*nbc+j);
-                s1 = s1+(*(param1+i*nbc+j)*(*(param1+i*nbc+j)));
-                m2 = m2 + *(param2+i*nbc+j);
-                s2 = s2+(*(param2+i*nbc+j)*(*(param2+i*nbc+j)));
-            }
-        }
+        m1 = t1.somme(rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1);
+        s1 = tc1.somme(rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1);
+        m2 = t2.somme(rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1);
+        s2 = tc2.somme(rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1);
         moy1[current_rectangle] = (m1 / nbp);
         var1[current_rectangle] = ((double)(s1/nbp-(m1*m1)/(nbp*nbp)));
         if( var1[current_rectangle] > 0 ) {
@@ -139,69 +119,360 @@ void ClassAnalysis::estimateur(double *param1,double *param2,double moy1[],doubl
 }
 
 void ClassAnalysis::classif(double *param1,double *param2,double moy1[],double var1[],double moy2[],double var2[],int fen,int nbl,int nbc, Image **classify_result, int num_classes ) {
-    //char nom[40];
-    int i,j,k,l,numclass;
-    double distmin,dist,d1,d2;
-    short *resclass;
-    double num_class_multiplier = 250.0 / ((double)(num_classes-1));
 
-    //printf("nom de l'image resultat de classification :");
-    //scanf("%s",nom);
+    // Distance normalisee au carre : la racine ne change pas le minimum et les
+    // divisions par les ecarts-types deviennent des multiplications par leurs inverses.
+    vector<double> inv1(num_classes), inv2(num_classes);
+    vector<uint8_t> niveau(num_classes);
+    const double num_class_multiplier = num_classes > 1 ? 250.0 / ((double)(num_classes-1)) : 0.;
+    for(int l=0 ; l<num_classes ; l++) {
+        inv1[l] = 1. / var1[l];
+        inv2[l] = 1. / var2[l];
+        niveau[l] = (uint8_t)(short)(l * num_class_multiplier);
+    }
 
-    resclass = (short *)calloc(nbl*nbc,sizeof(short));
+    GrayscaleImage* result = new GrayscaleImage(nbc, nbl);
+    uint8_t* resclass = result->begin();
 
 /* classification */
-    for(i=0 ; i<nbl ; i++)
-    {
-      k=i*nbc;
-      for(j=0 ; j<nbc ; j++)
-      {
-         distmin = 10000;
-         for(l=0 ; l<num_classes ; l++)
-         {
-          d1 = (*(param1+k+j) - moy1[l])/var1[l];
-            d2 = (*(param2+k+j) - moy2[l])/var2[l];
-            dist = sqrt((double)(d1*d1+d2*d2));
-            if(dist < distmin)
+    Parallel::forBands(0, nbl, [&](int debut, int fin) {
+        // les classes sont parcourues pour toute une ligne a la fois : la boucle sur les pixels, sans branche,
+        // est vectorisee par le compilateur en -O3 (build Release par defaut, voir CMakeLists.txt)
+        vector<double> distmin(nbc);
+        vector<double> numclass(nbc); // numero de classe en double pour rester dans les memes registres que les distances
+        for(int i=debut ; i<fin ; i++)
+        {
+            const double *p1 = param1 + (long)i*nbc;
+            const double *p2 = param2 + (long)i*nbc;
+            double *dmin = &distmin[0];
+            double *num = &numclass[0];
+            for(int j=0 ; j<nbc ; j++) {
+                dmin[j] = 10000. * 10000.;
+                num[j] = 0;
+            }
+            for(int l=0 ; l<num_classes ; l++)
             {
-              distmin = dist;
-              numclass = l;
+                const double m1 = moy1[l], m2 = moy2[l], i1 = inv1[l], i2 = inv2[l], cl = l;
+                for(int j=0 ; j<nbc ; j++)
+                {
+                    const double d1 = (p1[j] - m1) * i1;
+                    const double d2 = (p2[j] - m2) * i2;
+                    const double dist = d1*d1 + d2*d2;
+                    double d = dmin[j], n = num[j];
+                    if(dist < d) {
+                        d = dist;
+                        n = cl;
+                    }
+                    dmin[j] = d;
+                    num[j] = n;
+                }
             }
-         }
-         *(resclass+k+j) = (short)(numclass * num_class_multiplier);
-      }
+            uint8_t *res = resclass + (long)i*nbc;
+            for(int j=0 ; j<nbc ; j++)
+                res[j] = niveau[(int)num[j]];
+        }
+    });
+
+    *classify_result = result;
+}
+
+const char* ClassAnalysis::featureName(int feature) {
+    static const char* const noms[NB_FEATURES] = {
+        "mean", "standard deviation", "entropy", "gradient energy",
+        "Laws E5L5", "Laws L5E5", "Laws S5S5", "Laws R5R5"
+    };
+    return feature >= 0 && feature < NB_FEATURES ? noms[feature] : "unknown";
+}
+
+void ClassAnalysis::analyse_features(int fen, const uint8_t *imorig, int nbl, int nbc, const vector<int>& features, FeatureStack& stack) {
+    if(fen < 3) fen=3;
+    if(!( fen < (nbl * 2) && fen < (nbc * 2) )) {
+        throw "Error in ClassAnalysis::analyse_features:\nthe window is larger than the image";
     }
+    for(size_t k = 0; k < features.size(); k++) {
+        if(features[k] < 0 || features[k] >= NB_FEATURES) {
+            throw "Error in ClassAnalysis::analyse_features:\nunknown feature";
+        }
+    }
+    const int fen2 = fen/2;
+    const long size = (long)nbl * nbc;
+    stack.width = nbc;
+    stack.height = nbl;
+    stack.features = features;
+    stack.data.assign(features.size() * size, 0.);
 
-/* sauvegarde image rsultat de classification dans un fichier */
-  *classify_result = new GrayscaleImage(nbc, nbl);
-//    Pixel pixel;
-    int wcounter, hcounter;
-    for( hcounter=0; hcounter< nbl; hcounter++ ) {
-        for( wcounter=0; wcounter< nbc; wcounter++ ) {
-//          pixel.red = resclass[ hcounter * nbc + wcounter  ];
-//            pixel.green = pixel.red;
-//            pixel.blue = pixel.red;
-            (*classify_result)->setPixelAt( wcounter, hcounter, resclass[hcounter * nbc + wcounter] );
+    auto miroir = [](int i, int n) {
+        i = abs(i);
+        return i >= n ? 2 * n - i - 2 : i;
+    };
+    auto indice = [&](int f) {
+        for(size_t k = 0; k < features.size(); k++)
+            if(features[k] == f) return (int)k;
+        return -1;
+    };
+
+    // moyenne et ecart-type : memes valeurs que analyse()
+    const int kMoy = indice(MEAN), kDev = indice(STDEV);
+    if(kMoy >= 0 || kDev >= 0) {
+        vector<double> moy, dev;
+        double *p1 = kMoy >= 0 ? stack.plane(kMoy) : (moy.resize(size), &moy[0]);
+        double *p2 = kDev >= 0 ? stack.plane(kDev) : (dev.resize(size), &dev[0]);
+        analyse(fen, const_cast<uint8_t*>(imorig), p1, p2, nbl, nbc);
+    }
+
+    // entropie : histogramme glissant de la fenetre sur 32 classes, mis a jour
+    // colonne par colonne, avec la somme des c.log(c) tenue a jour
+    const int kEnt = indice(ENTROPY);
+    if(kEnt >= 0) {
+        const int nbp = fen * fen;
+        vector<double> clogc(nbp + 1, 0.);
+        for(int n = 1; n <= nbp; n++) clogc[n] = n * log((double)n);
+        const double logN = log((double)nbp);
+        double *ent = stack.plane(kEnt);
+        Parallel::forBands(0, nbl, [&](int debut, int fin) {
+            int histo[32];
+            vector<int> lignes(fen);
+            for(int i = debut; i < fin; i++) {
+                for(int k = 0; k < fen; k++) lignes[k] = miroir(i + k - fen2, nbl) * nbc;
+                std::fill(histo, histo + 32, 0);
+                for(int k = 0; k < fen; k++)
+                    for(int l = -fen2; l <= fen2; l++)
+                        histo[imorig[lignes[k] + miroir(l, nbc)] >> 3]++;
+                double s = 0.;
+                for(int b = 0; b < 32; b++) s += clogc[histo[b]];
+                for(int j = 0; j < nbc; j++) {
+                    ent[(long)i*nbc+j] = (logN - s / nbp) / log(2.);
+                    if(j + 1 == nbc) break;
+                    const int sortante = miroir(j - fen2, nbc), entrante = miroir(j + fen2 + 1, nbc);
+                    for(int k = 0; k < fen; k++) {
+                        int& hs = histo[imorig[lignes[k] + sortante] >> 3];
+                        s += clogc[hs - 1] - clogc[hs];
+                        hs--;
+                        int& he = histo[imorig[lignes[k] + entrante] >> 3];
+                        s += clogc[he + 1] - clogc[he];
+                        he++;
+                    }
+                }
+            }
+        });
+    }
+
+    // gradient et textures de Laws : reponses ponctuelles calculees en une seule
+    // passe sur l'image, a partir des lignes filtrees horizontalement par les
+    // noyaux L5, E5, S5 et R5, puis moyennees sur la fenetre par sommes cumulees
+    const int kPonct[5] = { indice(GRADIENT), indice(LAWS_E5L5), indice(LAWS_L5E5), indice(LAWS_S5S5), indice(LAWS_R5R5) };
+    bool ponctuelles = false;
+    for(int k = 0; k < 5; k++) ponctuelles |= kPonct[k] >= 0;
+    if(ponctuelles) {
+        static const int L5[5] = { 1, 4, 6, 4, 1 };
+        static const int E5[5] = { -1, -2, 0, 2, 1 };
+        static const int S5[5] = { -1, 0, 2, 0, -1 };
+        static const int R5[5] = { 1, -4, 6, -4, 1 };
+        const int* const noyaux[4] = { L5, E5, S5, R5 };
+        // filtrage horizontal : plan h*size + p pour le noyau h
+        vector<int> horiz(4 * size);
+        Parallel::forBands(0, nbl, [&](int debut, int fin) {
+            for(int i = debut; i < fin; i++) {
+                const uint8_t *ligne = imorig + (long)i * nbc;
+                for(int j = 0; j < nbc; j++) {
+                    int v[5];
+                    for(int t = 0; t < 5; t++) v[t] = ligne[miroir(j + t - 2, nbc)];
+                    for(int h = 0; h < 4; h++) {
+                        int acc = 0;
+                        for(int t = 0; t < 5; t++) acc += noyaux[h][t] * v[t];
+                        horiz[h * size + (long)i * nbc + j] = acc;
+                    }
+                }
+            }
+        });
+        // passe fusionnee : gradient de Sobel et reponses de Laws de chaque pixel
+        Parallel::forBands(0, nbl, [&](int debut, int fin) {
+            for(int i = debut; i < fin; i++) {
+                long l[5];
+                for(int t = 0; t < 5; t++) l[t] = (long)miroir(i + t - 2, nbl) * nbc;
+                for(int j = 0; j < nbc; j++) {
+                    const long p = (long)i * nbc + j;
+                    if(kPonct[0] >= 0) {
+                        const int jg = miroir(j - 1, nbc), jd = miroir(j + 1, nbc);
+                        const uint8_t *h = imorig + l[1], *m = imorig + l[2], *b = imorig + l[3];
+                        const double gx = (h[jd] + 2 * m[jd] + b[jd]) - (h[jg] + 2 * m[jg] + b[jg]);
+                        const double gy = (b[jg] + 2 * b[j] + b[jd]) - (h[jg] + 2 * h[j] + h[jd]);
+                        stack.plane(kPonct[0])[p] = gx * gx + gy * gy;
+                    }
+                    // noyau vertical applique aux lignes filtrees par le noyau horizontal
+                    static const int combinaisons[4][2] = { {1, 0}, {0, 1}, {2, 2}, {3, 3} }; // E5L5, L5E5, S5S5, R5R5
+                    for(int c = 0; c < 4; c++) {
+                        if(kPonct[c + 1] < 0) continue;
+                        const int *vert = noyaux[combinaisons[c][0]];
+                        const int *hz = &horiz[combinaisons[c][1] * size + j];
+                        int acc = 0;
+                        for(int t = 0; t < 5; t++) acc += vert[t] * hz[l[t]];
+                        stack.plane(kPonct[c + 1])[p] = abs(acc);
+                    }
+                }
+            }
+        });
+        vector<int>().swap(horiz);
+
+        // moyenne locale de chaque reponse (valeurs entieres : sommes exactes)
+        const int nbp = fen * fen;
+        for(int k = 0; k < 5; k++) {
+            if(kPonct[k] < 0) continue;
+            double *plan = stack.plane(kPonct[k]);
+            const TableSommes<int64_t> sommes(nbc + 2 * fen2, nbl + 2 * fen2, [&](int x, int y) {
+                return (int64_t)plan[(long)miroir(y - fen2, nbl) * nbc + miroir(x - fen2, nbc)];
+            });
+            Parallel::forBands(0, nbl, [&](int debut, int fin) {
+                for(int i = debut; i < fin; i++)
+                    for(int j = 0; j < nbc; j++)
+                        plan[(long)i*nbc+j] = (double)sommes.somme(j, i, j + fen, i + fen) / nbp;
+            });
         }
     }
-//	ecrire_image(resclass,nom,nbc,nbl);
+}
 
-/* libration mmoire alloue */
-  free(resclass);
+void ClassAnalysis::estimateur_features(const FeatureStack& stack, const vector<Rectangle>& rectangles, vector<ClassModel>& classes) {
+    const int n = stack.features.size();
+    const int nbc = stack.width;
+    classes.assign(rectangles.size(), ClassModel());
+    vector<double> x(n);
+    for(size_t c = 0; c < rectangles.size(); c++) {
+        Rectangle rect = rectangles[c];
+        NormalizeRectangle( rect );
+        const double nbp = ((double)(rect.bottom() - rect.top()) + 1) * ((rect.right() - rect.left()) + 1);
+        vector<double>& moy = classes[c].mean;
+        vector<double>& cov = classes[c].covariance;
+        moy.assign(n, 0.);
+        cov.assign(n * n, 0.);
+        for(unsigned int i=rect.top() ; i<=rect.bottom() ; i++)
+            for(unsigned int j=rect.left() ; j<=rect.right() ; j++)
+                for(int k = 0; k < n; k++)
+                    moy[k] += stack.plane(k)[(long)i*nbc+j];
+        for(int k = 0; k < n; k++) moy[k] /= nbp;
+        // covariance centree (deux passes pour la precision)
+        for(unsigned int i=rect.top() ; i<=rect.bottom() ; i++) {
+            for(unsigned int j=rect.left() ; j<=rect.right() ; j++) {
+                for(int k = 0; k < n; k++) x[k] = stack.plane(k)[(long)i*nbc+j] - moy[k];
+                for(int k = 0; k < n; k++)
+                    for(int l = 0; l <= k; l++)
+                        cov[k*n+l] += x[k] * x[l];
+            }
+        }
+        for(int k = 0; k < n; k++) {
+            for(int l = 0; l <= k; l++) {
+                cov[k*n+l] /= nbp;
+                cov[l*n+k] = cov[k*n+l];
+            }
+        }
+    }
+}
+
+void ClassAnalysis::classif_mahalanobis(const FeatureStack& stack, const vector<ClassModel>& classes, Image **classify_result) {
+    const int n = stack.features.size();
+    const int num_classes = classes.size();
+    const int nbc = stack.width, nbl = stack.height;
+    if(num_classes == 0) {
+        throw "Error in ClassAnalysis::classif_mahalanobis:\nno class";
+    }
+
+    // Pour chaque classe, W = L^-1 avec L.L^T = covariance (Cholesky, regularisee
+    // par une fraction de sa trace) : la distance de Mahalanobis est |W.(x - moy)|^2
+    vector<double> blanchiment(num_classes * n * n, 0.);
+    for(int c = 0; c < num_classes; c++) {
+        if((int)classes[c].mean.size() != n || (int)classes[c].covariance.size() != n * n) {
+            throw "Error in ClassAnalysis::classif_mahalanobis:\nthe classes do not match the features";
+        }
+        vector<double> a = classes[c].covariance;
+        double trace = 0.;
+        for(int k = 0; k < n; k++) trace += a[k*n+k];
+        const double eps = std::max(1e-6 * trace / n, 1e-6);
+        for(int k = 0; k < n; k++) a[k*n+k] += eps;
+        vector<double> L(n * n, 0.);
+        for(int k = 0; k < n; k++) {
+            for(int l = 0; l <= k; l++) {
+                double s = a[k*n+l];
+                for(int m = 0; m < l; m++) s -= L[k*n+m] * L[l*n+m];
+                if(k == l) {
+                    if(s <= 0.) throw "Error in ClassAnalysis::classif_mahalanobis:\na covariance matrix is not positive definite";
+                    L[k*n+k] = sqrt(s);
+                }
+                else L[k*n+l] = s / L[l*n+l];
+            }
+        }
+        // inversion de la matrice triangulaire inferieure L
+        double *W = &blanchiment[c * n * n];
+        for(int col = 0; col < n; col++) {
+            for(int k = col; k < n; k++) {
+                double s = k == col ? 1. : 0.;
+                for(int m = col; m < k; m++) s -= L[k*n+m] * W[m*n+col];
+                W[k*n+col] = s / L[k*n+k];
+            }
+        }
+    }
+
+    vector<uint8_t> niveau(num_classes);
+    const double num_class_multiplier = num_classes > 1 ? 250.0 / ((double)(num_classes-1)) : 0.;
+    for(int l=0 ; l<num_classes ; l++) niveau[l] = (uint8_t)(short)(l * num_class_multiplier);
+
+    GrayscaleImage* result = new GrayscaleImage(nbc, nbl);
+    uint8_t* resclass = result->begin();
+
+    Parallel::forBands(0, nbl, [&](int debut, int fin) {
+        vector<double> centre(n * nbc), dist(nbc), distmin(nbc), numclass(nbc), t(nbc);
+        for(int i = debut; i < fin; i++) {
+            for(int j = 0; j < nbc; j++) {
+                distmin[j] = HUGE_VAL;
+                numclass[j] = 0.;
+            }
+            for(int c = 0; c < num_classes; c++) {
+                const double *W = &blanchiment[c * n * n];
+                for(int k = 0; k < n; k++) {
+                    const double *x = stack.plane(k) + (long)i * nbc;
+                    double *xc = &centre[k * nbc];
+                    const double m = classes[c].mean[k];
+                    for(int j = 0; j < nbc; j++) xc[j] = x[j] - m;
+                }
+                double *d = &dist[0];
+                std::fill(d, d + nbc, 0.);
+                for(int k = 0; k < n; k++) {
+                    double *tk = &t[0];
+                    std::fill(tk, tk + nbc, 0.);
+                    for(int m = 0; m <= k; m++) {
+                        const double w = W[k*n+m];
+                        const double *xc = &centre[m * nbc];
+                        for(int j = 0; j < nbc; j++) tk[j] += w * xc[j];
+                    }
+                    for(int j = 0; j < nbc; j++) d[j] += tk[j] * tk[j];
+                }
+                double *dmin = &distmin[0], *num = &numclass[0];
+                const double cl = c;
+                for(int j = 0; j < nbc; j++) {
+                    double dm = dmin[j], nm = num[j];
+                    if(d[j] < dm) {
+                        dm = d[j];
+                        nm = cl;
+                    }
+                    dmin[j] = dm;
+                    num[j] = nm;
+                }
+            }
+            uint8_t *res = resclass + (long)i * nbc;
+            for(int j = 0; j < nbc; j++) res[j] = niveau[(int)numclass[j]];
+        }
+    });
+
+    *classify_result = result;
 }
 
 void ClassAnalysis::write_to_file( GrayscaleImage *learning, const vector<Rectangle>& rectangles, FILE *f, int learning_fen, Image_t<double> **returnval_mean, Image_t<double> **returnval_stdev ) {
-  char buffer[255];
     if(( learning == NULL )) {
-        sprintf( buffer, "Error in ClassAnalysis::write_to_file:\nlearning = %p", learning);
-        throw buffer;
+        throw "Error in ClassAnalysis::write_to_file:\nlearning = NULL";
     }
     if( f == NULL ) {
         throw "Error in ClassAnalysis::write_to_file:\nf = NULL";
     }
     if(!( ( learning_fen & 1 ) == 1 )) {
-        sprintf( buffer, "Error in ClassAnalysis::write_to_file:\nlearning_fen = %d", learning_fen );
-        throw buffer;
+        throw "Error in ClassAnalysis::write_to_file:\nthe window size must be odd";
     }
     if( rectangles.empty() ) {
       throw "Error in ClassAnalysis::write_to_file:\nrectangles.empty() = TRUE";
@@ -236,15 +507,22 @@ void ClassAnalysis::write_to_file( GrayscaleImage *learning, const vector<Rectan
 //	printf("\n\n- estimation des parametres caracteristiques  \n");
     estimateur(param1,param2,moy1,var1,moy2,var2,learning_fen,nbl,nbc,rectangles);
 
-    fprintf( f, "MEAN_STDEV\n" );
-    fprintf( f, "%d\n", learning_fen );
-    fprintf( f, "%lu\n", rectangles.size() );
-    vector<Rectangle>::const_iterator iter;
-    i = 0;
-    for(iter=rectangles.begin();iter!=rectangles.end();++iter) {
-      fprintf( f, "%f %f %f %f\n", moy1[i], var1[i], moy2[i], var2[i] );
-        i++;
+    Model model;
+    model.type = Model::MEAN_STDEV;
+    model.fen = learning_fen;
+    model.features.push_back(MEAN);
+    model.features.push_back(STDEV);
+    model.classes.assign(rectangles.size(), ClassModel());
+    // estimateur donne des ecarts-types, le modele garde des variances
+    for(i = 0; i < (long)rectangles.size(); i++) {
+        model.classes[i].mean.push_back(moy1[i]);
+        model.classes[i].mean.push_back(moy2[i]);
+        model.classes[i].covariance.push_back(var1[i] * var1[i]);
+        model.classes[i].covariance.push_back(0.);
+        model.classes[i].covariance.push_back(0.);
+        model.classes[i].covariance.push_back(var2[i] * var2[i]);
     }
+    write_model( f, model );
 
     if( returnval_mean != NULL ) {
         (*returnval_mean) = new Image_t<double>(nbc, nbl, 1, param1);
@@ -252,28 +530,509 @@ void ClassAnalysis::write_to_file( GrayscaleImage *learning, const vector<Rectan
     if( returnval_stdev != NULL ) {
         (*returnval_stdev) = new Image_t<double>(nbc, nbl, 1, param2);
     }
-    /*
-    return_string = "valeur des parametres estimes :\n\n";
-    for(i=0 ; i<4 ; i++)
+
+    // Erase memory allocated (im1 belongs to learning)
+    delete[] moy1;
+    delete[] var1;
+    delete[] moy2;
+    delete[] var2;
+    delete[] param1;
+    delete[] param2;
+}
+
+/* k-means on the feature vectors, each feature being centered and divided by
+ * its standard deviation over the image. Initialization by k-means++ on a
+ * sample of the pixels. Up to KMEANS_LLOYD_MAX pixels every iteration assigns
+ * all the pixels (Lloyd) ; beyond, the centers are updated from random
+ * mini-batches and only the final pass goes through the whole image.
+ * The pixels are assigned in blocks of rows processed in parallel, the
+ * partial sums being added in block order : the result does not depend on
+ * the number of threads. The classes are sorted by increasing first feature
+ * and returned with the mean and covariance of their pixels. */
+void ClassAnalysis::kmeans(const FeatureStack& stack, int k, vector<ClassModel>& classes, Image **classify_result) {
+    const int n = stack.features.size();
+    const int nbc = stack.width, nbl = stack.height;
+    const long size = (long)nbl * nbc;
+    if( k < 1 || k > 255 || k > size || n == 0 ) {
+        throw "Error in ClassAnalysis::kmeans:\ninvalid number of clusters";
+    }
+    const long KMEANS_LLOYD_MAX = 1L << 22;
+    const int BLOC = 64; // lignes par bloc
+    const int nbBlocs = (nbl + BLOC - 1) / BLOC;
+
+    // normalisation des caracteristiques
+    vector<double> moy(n, 0.), echelle(n, 1.);
+    for(int f = 0; f < n; f++) {
+        const double *x = stack.plane(f);
+        double s = 0., ss = 0.;
+        for(long p = 0; p < size; p++) {
+            s += x[p];
+            ss += x[p] * x[p];
+        }
+        moy[f] = s / size;
+        const double var = ss / size - moy[f] * moy[f];
+        if(var > 1e-12) echelle[f] = 1. / sqrt(var);
+    }
+    auto vecteur = [&](long p, double *x) {
+        for(int f = 0; f < n; f++) x[f] = (stack.plane(f)[p] - moy[f]) * echelle[f];
+    };
+    auto plusProche = [&](const double *x, const vector<double>& centres) {
+        int best = 0;
+        double dmin = HUGE_VAL;
+        for(int c = 0; c < k; c++) {
+            double d = 0.;
+            for(int f = 0; f < n; f++) {
+                const double e = x[f] - centres[c*n+f];
+                d += e * e;
+            }
+            if(d < dmin) {
+                dmin = d;
+                best = c;
+            }
+        }
+        return best;
+    };
+
+    // k-means++ sur un echantillon
+    std::mt19937 gen(1);
+    const long nbEch = std::min(size, 65536L);
+    vector<double> ech(nbEch * n);
     {
-      sprintf(buffer, "Classe no %1d \n",i+1);
-        return_string = return_string + buffer;
-      sprintf(buffer, "parametre 1 ---> moyenne = %5.1f \n",moy1[i]);
-      return_string = return_string + buffer;
-        sprintf(buffer, "parametre 2 ---> ecart-type = %4.1f\n",var2[i]);
-        return_string = return_string + buffer;
+        std::uniform_int_distribution<long> tirage(0, size - 1);
+        for(long e = 0; e < nbEch; e++) vecteur(nbEch == size ? e : tirage(gen), &ech[e * n]);
     }
-*/
-    // Erase memory allocated
-    delete im1;
-    delete moy1;
-    delete var1;
-    delete moy2;
-    delete var2;
-    delete param1;
-    delete param2;
-//	delete learning_result_1;
-//	delete learning_result_2;
+    vector<double> centres(k * n);
+    vector<double> d2(nbEch, HUGE_VAL);
+    long choisi = std::uniform_int_distribution<long>(0, nbEch - 1)(gen);
+    for(int c = 0; c < k; c++) {
+        std::copy(&ech[choisi * n], &ech[choisi * n] + n, &centres[c * n]);
+        if(c + 1 == k) break;
+        double total = 0.;
+        for(long e = 0; e < nbEch; e++) {
+            double d = 0.;
+            for(int f = 0; f < n; f++) {
+                const double v = ech[e*n+f] - centres[c*n+f];
+                d += v * v;
+            }
+            d2[e] = std::min(d2[e], d);
+            total += d2[e];
+        }
+        if(total <= 0.) {
+            choisi = std::uniform_int_distribution<long>(0, nbEch - 1)(gen);
+            continue;
+        }
+        double seuil = std::uniform_real_distribution<double>(0., total)(gen);
+        choisi = nbEch - 1;
+        for(long e = 0; e < nbEch; e++) {
+            seuil -= d2[e];
+            if(seuil < 0.) {
+                choisi = e;
+                break;
+            }
+        }
+    }
+    vector<double>().swap(d2);
+
+    // affectation des pixels d'une ligne : vecteurs normalises ranges par caracteristique
+    // puis distance a chaque centre, boucles sur les pixels contigus
+    auto affecterLigne = [&](int i, const vector<double>& ctr, vector<double>& tmp, uint8_t *lab) {
+        tmp.resize((n + 3) * nbc);
+        double *dmin = &tmp[n * nbc], *num = &tmp[(n + 1) * nbc], *dc = &tmp[(n + 2) * nbc];
+        for(int f = 0; f < n; f++) {
+            const double *x = stack.plane(f) + (long)i * nbc;
+            double *xn = &tmp[f * nbc];
+            const double m = moy[f], s = echelle[f];
+            for(int j = 0; j < nbc; j++) xn[j] = (x[j] - m) * s;
+        }
+        for(int j = 0; j < nbc; j++) {
+            dmin[j] = HUGE_VAL;
+            num[j] = 0.;
+        }
+        for(int c = 0; c < k; c++) {
+            std::fill(dc, dc + nbc, 0.);
+            for(int f = 0; f < n; f++) {
+                const double *xn = &tmp[f * nbc];
+                const double m = ctr[c*n+f];
+                for(int j = 0; j < nbc; j++) dc[j] += (xn[j] - m) * (xn[j] - m);
+            }
+            const double cl = c;
+            for(int j = 0; j < nbc; j++) {
+                double dm = dmin[j], nm = num[j];
+                if(dc[j] < dm) {
+                    dm = dc[j];
+                    nm = cl;
+                }
+                dmin[j] = dm;
+                num[j] = nm;
+            }
+        }
+        for(int j = 0; j < nbc; j++) lab[j] = (uint8_t)num[j];
+    };
+
+    vector<uint8_t> labels(size, 0);
+    if(size <= KMEANS_LLOYD_MAX) {
+        // Lloyd : sommes partielles par bloc de lignes
+        vector<double> sommes(nbBlocs * k * n);
+        vector<long> nombres(nbBlocs * k);
+        vector<long> changements(nbBlocs);
+        for(int iter = 0; iter < 100; iter++) {
+            std::fill(sommes.begin(), sommes.end(), 0.);
+            std::fill(nombres.begin(), nombres.end(), 0L);
+            Parallel::forEach(0, nbBlocs, [&](int b) {
+                vector<double> tmp;
+                vector<uint8_t> lab(nbc);
+                double *s = &sommes[b * k * n];
+                long *nb = &nombres[b * k];
+                long change = 0;
+                for(int i = b * BLOC; i < std::min(nbl, (b + 1) * BLOC); i++) {
+                    affecterLigne(i, centres, tmp, &lab[0]);
+                    uint8_t *ancien = &labels[(long)i * nbc];
+                    for(int j = 0; j < nbc; j++) {
+                        const int c = lab[j];
+                        change += c != ancien[j];
+                        ancien[j] = c;
+                        nb[c]++;
+                        for(int f = 0; f < n; f++) s[c*n+f] += tmp[f * nbc + j];
+                    }
+                }
+                changements[b] = change;
+            });
+            long change = 0;
+            for(int b = 0; b < nbBlocs; b++) change += changements[b];
+            for(int c = 0; c < k; c++) {
+                long nb = 0;
+                vector<double> s(n, 0.);
+                for(int b = 0; b < nbBlocs; b++) {
+                    nb += nombres[b * k + c];
+                    for(int f = 0; f < n; f++) s[f] += sommes[(b * k + c) * n + f];
+                }
+                if(nb > 0) {
+                    for(int f = 0; f < n; f++) centres[c*n+f] = s[f] / nb;
+                }
+            }
+            if(iter > 0 && change * 1000 <= size) break;
+        }
+    }
+    else {
+        // mini-batch : chaque centre se deplace vers les pixels du lot avec un pas 1/(nombre de pixels vus)
+        const int LOT = 4096;
+        vector<long> vus(k, 0);
+        vector<double> lot(LOT * n);
+        vector<int> affectation(LOT);
+        std::uniform_int_distribution<long> tirage(0, size - 1);
+        for(int iter = 0; iter < 200; iter++) {
+            for(int e = 0; e < LOT; e++) vecteur(tirage(gen), &lot[e * n]);
+            Parallel::forBands(0, LOT, [&](int debut, int fin) {
+                for(int e = debut; e < fin; e++) affectation[e] = plusProche(&lot[e * n], centres);
+            }, 512);
+            for(int e = 0; e < LOT; e++) {
+                const int c = affectation[e];
+                const double eta = 1. / ++vus[c];
+                for(int f = 0; f < n; f++) centres[c*n+f] += eta * (lot[e*n+f] - centres[c*n+f]);
+            }
+        }
+    }
+
+    // ordre des classes : premiere caracteristique croissante
+    vector<int> ordre(k), rang(k);
+    for(int c = 0; c < k; c++) ordre[c] = c;
+    std::stable_sort(ordre.begin(), ordre.end(), [&](int a, int b) { return centres[a*n] < centres[b*n]; });
+    for(int c = 0; c < k; c++) rang[ordre[c]] = c;
+
+    // affectation finale, moyenne et covariance (unites d'origine) de chaque classe
+    vector<uint8_t> niveau(k);
+    const double num_class_multiplier = k > 1 ? 250.0 / ((double)(k-1)) : 0.;
+    for(int l=0 ; l<k ; l++) niveau[l] = (uint8_t)(short)(l * num_class_multiplier);
+    GrayscaleImage* result = new GrayscaleImage(nbc, nbl);
+    uint8_t* resclass = result->begin();
+    vector<double> sommes(nbBlocs * k * n, 0.), produits(nbBlocs * k * n * n, 0.);
+    vector<long> nombres(nbBlocs * k, 0);
+    Parallel::forEach(0, nbBlocs, [&](int b) {
+        vector<double> tmp;
+        vector<uint8_t> lab(nbc);
+        vector<double> x(n);
+        double *s = &sommes[b * k * n], *pr = &produits[b * k * n * n];
+        long *nb = &nombres[b * k];
+        for(int i = b * BLOC; i < std::min(nbl, (b + 1) * BLOC); i++) {
+            affecterLigne(i, centres, tmp, &lab[0]);
+            uint8_t *res = resclass + (long)i * nbc;
+            for(int j = 0; j < nbc; j++) {
+                const int c = rang[lab[j]];
+                res[j] = niveau[c];
+                nb[c]++;
+                for(int f = 0; f < n; f++) {
+                    x[f] = stack.plane(f)[(long)i * nbc + j];
+                    s[c*n+f] += x[f];
+                }
+                for(int f = 0; f < n; f++)
+                    for(int g = 0; g <= f; g++)
+                        pr[(c*n+f)*n+g] += x[f] * x[g];
+            }
+        }
+    });
+
+    classes.assign(k, ClassModel());
+    for(int c = 0; c < k; c++) {
+        long nb = 0;
+        vector<double>& m = classes[c].mean;
+        vector<double>& cov = classes[c].covariance;
+        m.assign(n, 0.);
+        cov.assign(n * n, 0.);
+        for(int b = 0; b < nbBlocs; b++) {
+            nb += nombres[b * k + c];
+            for(int f = 0; f < n; f++) m[f] += sommes[(b * k + c) * n + f];
+            for(int f = 0; f < n * n; f++) cov[f] += produits[(b * k + c) * n * n + f];
+        }
+        if(nb == 0) {
+            // classe vide : centre de k-means, sans dispersion
+            for(int f = 0; f < n; f++) m[f] = centres[ordre[c]*n+f] / echelle[f] + moy[f];
+            continue;
+        }
+        for(int f = 0; f < n; f++) m[f] /= nb;
+        for(int f = 0; f < n; f++) {
+            for(int g = 0; g <= f; g++) {
+                cov[f*n+g] = cov[f*n+g] / nb - m[f] * m[g];
+                cov[g*n+f] = cov[f*n+g];
+            }
+        }
+    }
+
+    *classify_result = result;
+}
+
+/* Binary model file : the magic number, then 32-bit unsigned integers and
+ * IEEE-754 doubles, all little-endian whatever the machine :
+ *   "ICAM" version type fen nb_features features[nb_features] nb_classes
+ *   then for each class mean[nb_features] covariance[nb_features^2] */
+static const char MODEL_MAGIC[4] = { 'I', 'C', 'A', 'M' };
+static const uint32_t MODEL_VERSION = 1;
+static const uint32_t MODEL_MAX_CLASSES = 65535;
+
+static void ecrire32( vector<uint8_t>& buf, uint32_t v ) {
+    for(int b = 0; b < 4; b++) buf.push_back((uint8_t)(v >> (8 * b)));
+}
+
+static void ecrire64( vector<uint8_t>& buf, double d ) {
+    static_assert(std::numeric_limits<double>::is_iec559 && sizeof(double) == 8, "IEEE-754 doubles required");
+    uint64_t v;
+    memcpy(&v, &d, 8);
+    for(int b = 0; b < 8; b++) buf.push_back((uint8_t)(v >> (8 * b)));
+}
+
+static bool lire32( FILE *f, uint32_t& v ) {
+    uint8_t o[4];
+    if( fread( o, 1, 4, f ) != 4 ) return false;
+    v = (uint32_t)o[0] | ((uint32_t)o[1] << 8) | ((uint32_t)o[2] << 16) | ((uint32_t)o[3] << 24);
+    return true;
+}
+
+static bool lire64( FILE *f, double& d ) {
+    uint8_t o[8];
+    if( fread( o, 1, 8, f ) != 8 ) return false;
+    uint64_t v = 0;
+    for(int b = 7; b >= 0; b--) v = (v << 8) | o[b];
+    memcpy(&d, &v, 8);
+    return true;
+}
+
+void ClassAnalysis::write_model( FILE *f, const Model& model ) {
+    if( f == NULL ) {
+        throw "Error in ClassAnalysis::write_model:\nf = NULL";
+    }
+    const int n = model.features.size();
+    vector<uint8_t> buf(MODEL_MAGIC, MODEL_MAGIC + 4);
+    ecrire32( buf, MODEL_VERSION );
+    ecrire32( buf, model.type );
+    ecrire32( buf, model.fen );
+    ecrire32( buf, n );
+    for(int k = 0; k < n; k++) ecrire32( buf, model.features[k] );
+    ecrire32( buf, model.classes.size() );
+    for(size_t c = 0; c < model.classes.size(); c++) {
+        if( (int)model.classes[c].mean.size() != n || (int)model.classes[c].covariance.size() != n * n ) {
+            throw "Error in ClassAnalysis::write_model:\ninconsistent class model";
+        }
+        for(int k = 0; k < n; k++) ecrire64( buf, model.classes[c].mean[k] );
+        for(int k = 0; k < n * n; k++) ecrire64( buf, model.classes[c].covariance[k] );
+    }
+    if( fwrite( &buf[0], 1, buf.size(), f ) != buf.size() ) {
+        throw "Error in ClassAnalysis::write_model:\ncould not write the file";
+    }
+}
+
+/* Reads the part of a binary model following its magic number */
+static bool read_binary_model( FILE *f, Model& model ) {
+    uint32_t version, type, fen, n, num_classes;
+    if( !lire32( f, version ) || version == 0 || version > MODEL_VERSION ) return false;
+    if( !lire32( f, type ) || !lire32( f, fen ) || !lire32( f, n ) ) return false;
+    if( type > Model::FEATURES_MAHALANOBIS || n == 0 || n > NB_FEATURES ) return false;
+    // the window is centred on the pixel, hence odd
+    if( fen > (uint32_t)std::numeric_limits<int>::max() || ( fen & 1 ) == 0 ) return false;
+    if( type == Model::MEAN_STDEV && n != 2 ) return false;
+    model.type = type;
+    model.fen = fen;
+    model.features.resize(n);
+    for(uint32_t k = 0; k < n; k++) {
+        uint32_t feature;
+        if( !lire32( f, feature ) || feature >= NB_FEATURES ) return false;
+        model.features[k] = feature;
+    }
+    if( type == Model::MEAN_STDEV && ( model.features[0] != MEAN || model.features[1] != STDEV ) ) return false;
+    if( !lire32( f, num_classes ) || num_classes == 0 || num_classes > MODEL_MAX_CLASSES ) return false;
+    model.classes.assign(num_classes, ClassModel());
+    for(uint32_t c = 0; c < num_classes; c++) {
+        model.classes[c].mean.resize(n);
+        model.classes[c].covariance.resize(n * n);
+        for(uint32_t k = 0; k < n; k++)
+            if( !lire64( f, model.classes[c].mean[k] ) ) return false;
+        for(uint32_t k = 0; k < n * n; k++)
+            if( !lire64( f, model.classes[c].covariance[k] ) ) return false;
+    }
+    return true;
+}
+
+/* Reads the part of a FEATURES_MAHALANOBIS text file following its header */
+static bool read_features_model( FILE *f, Model& model ) {
+    int n, num_classes;
+    if( fscanf( f, "%d", &model.fen ) != 1 || model.fen <= 0 || ( model.fen & 1 ) == 0 || fscanf( f, "%d", &n ) != 1 || n <= 0 || n > NB_FEATURES ) {
+        return false;
+    }
+    model.type = Model::FEATURES_MAHALANOBIS;
+    model.features.resize(n);
+    for(int k = 0; k < n; k++) {
+        if( fscanf( f, "%d", &model.features[k] ) != 1 || model.features[k] < 0 || model.features[k] >= NB_FEATURES ) return false;
+    }
+    if( fscanf( f, "%d", &num_classes ) != 1 || num_classes <= 0 || num_classes > (int)MODEL_MAX_CLASSES ) {
+        return false;
+    }
+    model.classes.assign(num_classes, ClassModel());
+    for(int c = 0; c < num_classes; c++) {
+        model.classes[c].mean.resize(n);
+        model.classes[c].covariance.resize(n * n);
+        for(int k = 0; k < n; k++)
+            if( fscanf( f, "%lf", &model.classes[c].mean[k] ) != 1 ) return false;
+        for(int k = 0; k < n * n; k++)
+            if( fscanf( f, "%lf", &model.classes[c].covariance[k] ) != 1 ) return false;
+    }
+    return true;
+}
+
+/* Reads the part of a MEAN_STDEV text file following its header ; the text files hold standard deviations */
+static bool read_mean_stdev_model( FILE *f, Model& model ) {
+    int num_classes;
+    if( fscanf( f, "%d", &model.fen ) != 1 || model.fen <= 0 || ( model.fen & 1 ) == 0 || fscanf( f, "%d", &num_classes ) != 1 || num_classes <= 0 || num_classes > (int)MODEL_MAX_CLASSES ) {
+        return false;
+    }
+    model.type = Model::MEAN_STDEV;
+    model.features.clear();
+    model.features.push_back(MEAN);
+    model.features.push_back(STDEV);
+    model.classes.assign(num_classes, ClassModel());
+    for(int c = 0; c < num_classes; c++) {
+        double moy1, ect1, moy2, ect2;
+        if( fscanf( f, "%lf %lf %lf %lf", &moy1, &ect1, &moy2, &ect2 ) != 4 ) return false;
+        model.classes[c].mean.push_back(moy1);
+        model.classes[c].mean.push_back(moy2);
+        model.classes[c].covariance.push_back(ect1 * ect1);
+        model.classes[c].covariance.push_back(0.);
+        model.classes[c].covariance.push_back(0.);
+        model.classes[c].covariance.push_back(ect2 * ect2);
+    }
+    return true;
+}
+
+/* version is the version of the binary format, 0 for a text file */
+static bool read_model_version( FILE *f, Model& model, uint32_t& version ) {
+    const long debut = ftell( f );
+    char magic[4];
+    if( fread( magic, 1, 4, f ) == 4 && memcmp( magic, MODEL_MAGIC, 4 ) == 0 ) {
+        const long suite = ftell( f );
+        if( !lire32( f, version ) ) return false;
+        fseek( f, suite, SEEK_SET );
+        return read_binary_model( f, model );
+    }
+    fseek( f, debut, SEEK_SET );
+    version = 0;
+    char buffer[255];
+    if( fscanf( f, "%254s", buffer ) != 1 ) return false;
+    if( strcmp( buffer, "FEATURES_MAHALANOBIS" ) == 0 ) return read_features_model( f, model );
+    if( strcmp( buffer, "MEAN_STDEV" ) == 0 ) return read_mean_stdev_model( f, model );
+    return false;
+}
+
+bool ClassAnalysis::read_model( FILE *f, Model& model ) {
+    if( f == NULL ) {
+        throw "Error in ClassAnalysis::read_model:\nf = NULL";
+    }
+    uint32_t version;
+    return read_model_version( f, model, version );
+}
+
+/* Writes a FEATURES_MAHALANOBIS model */
+static void write_features_model( FILE *f, int fen, const vector<int>& features, const vector<ClassModel>& classes ) {
+    Model model;
+    model.type = Model::FEATURES_MAHALANOBIS;
+    model.fen = fen;
+    model.features = features;
+    model.classes = classes;
+    write_model( f, model );
+}
+
+/* Returns copies of the mean and standard deviation planes of the stack (NULL when absent) */
+static void feature_images( const FeatureStack& stack, Image_t<double> **returnval_mean, Image_t<double> **returnval_stdev ) {
+    if( returnval_mean != NULL ) *returnval_mean = NULL;
+    if( returnval_stdev != NULL ) *returnval_stdev = NULL;
+    for(size_t k = 0; k < stack.features.size(); k++) {
+        if( stack.features[k] == MEAN && returnval_mean != NULL ) {
+            (*returnval_mean) = new Image_t<double>(stack.width, stack.height, 1, stack.plane(k));
+        }
+        if( stack.features[k] == STDEV && returnval_stdev != NULL ) {
+            (*returnval_stdev) = new Image_t<double>(stack.width, stack.height, 1, stack.plane(k));
+        }
+    }
+}
+
+void ClassAnalysis::write_features_to_file( GrayscaleImage *learning, const vector<Rectangle>& rectangles, FILE *f, int learning_fen, const vector<int>& features, Image_t<double> **returnval_mean, Image_t<double> **returnval_stdev ) {
+    if( learning == NULL ) {
+        throw "Error in ClassAnalysis::write_features_to_file:\nlearning = NULL";
+    }
+    if( f == NULL ) {
+        throw "Error in ClassAnalysis::write_features_to_file:\nf = NULL";
+    }
+    if(!( ( learning_fen & 1 ) == 1 )) {
+        throw "Error in ClassAnalysis::write_features_to_file:\nthe window size must be odd";
+    }
+    if( rectangles.empty() ) {
+        throw "Error in ClassAnalysis::write_features_to_file:\nrectangles.empty() = TRUE";
+    }
+
+    FeatureStack stack;
+    analyse_features(learning_fen, learning->begin(), learning->getHeight(), learning->getWidth(), features, stack);
+    vector<ClassModel> classes;
+    estimateur_features(stack, rectangles, classes);
+
+    write_features_model( f, learning_fen, features, classes );
+    feature_images( stack, returnval_mean, returnval_stdev );
+}
+
+void ClassAnalysis::kmeans_to_file( GrayscaleImage *to_cluster, FILE *f, int fen, const vector<int>& features, int k, Image **classify_result, Image_t<double> **returnval_mean, Image_t<double> **returnval_stdev ) {
+    if( to_cluster == NULL ) {
+        throw "Error in ClassAnalysis::kmeans_to_file:\nto_cluster = NULL";
+    }
+    if( f == NULL ) {
+        throw "Error in ClassAnalysis::kmeans_to_file:\nf = NULL";
+    }
+    if(!( ( fen & 1 ) == 1 )) {
+        throw "Error in ClassAnalysis::kmeans_to_file:\nthe window size must be odd";
+    }
+
+    FeatureStack stack;
+    analyse_features(fen, to_cluster->begin(), to_cluster->getHeight(), to_cluster->getWidth(), features, stack);
+    vector<ClassModel> classes;
+    kmeans(stack, k, classes, classify_result);
+
+    // the clusters are saved as a model for the classification step
+    write_features_model( f, fen, features, classes );
+    feature_images( stack, returnval_mean, returnval_stdev );
 }
 
 void ClassAnalysis::NormalizeRectangle( Rectangle &rect ) {
@@ -288,74 +1047,44 @@ void ClassAnalysis::NormalizeRectangle( Rectangle &rect ) {
     rect.w = right - left;
 }
 
-void checkFscanfResult(int resultCode) {
-    if(resultCode == EOF) {
-        std::cerr << "ClassAnalysis: errors when reading a file." << std::endl;
-    }
-}
-
-Image *ClassAnalysis::classify_from_file( GrayscaleImage *to_classify, FILE *f, int classify_fen, Image_t<double> **returnval_mean, Image_t<double> **returnval_stdev ) {
+Image *ClassAnalysis::classify( GrayscaleImage *to_classify, const Model& model, int classify_fen, Image_t<double> **returnval_mean, Image_t<double> **returnval_stdev ) {
     if(!( to_classify != NULL )) {
-        throw "Error in ClassAnalysis::classify_from_file:\nto_classify = NULL";
-    }
-    if(!( f != NULL )) {
-      throw "Error in ClassAnalysis::classify_from_file:\nf = NULL";
+        throw "Error in ClassAnalysis::classify:\nto_classify = NULL";
     }
     if(!( ( classify_fen & 1 ) == 1 )) {
-        char buffer[255];
-        sprintf( buffer, "Error in ClassAnalysis::classify_from_file:\nclassify_fen = %d", classify_fen );
-        throw buffer;
+        throw "Error in ClassAnalysis::classify:\nthe window size must be odd";
     }
 
     Image *returnval = NULL;
-    char buffer[255];
-    int num_classes;
-    int counter;
-    double *param1,*param2, *moy1, *var1, *moy2, *var2;
-    long nbl,nbc;
-    //long size,i;
-    nbl = to_classify->getHeight();
-    nbc = to_classify->getWidth();
-
-    int r = fscanf( f, "%s", buffer );
-    checkFscanfResult(r);
-    if( strcmp( buffer, "MEAN_STDEV" ) == 0 ) {
-      r = fscanf( f, "%d", &num_classes ); // Old learning window size
-      checkFscanfResult(r);
-        r = fscanf( f, "%d", &num_classes );
-        checkFscanfResult(r);
-        if( num_classes <= 0 ) {
-          // Invalid number of classes
-            return NULL;
-        }
-        else {
-            moy1 = new double[ num_classes ];
-            var1 = new double[ num_classes ];
-            moy2 = new double[ num_classes ];
-            var2 = new double[ num_classes ];
-            for( counter=0; counter< num_classes; counter++ ) {
-              r = fscanf( f, "%lf", &moy1[counter] );
-              checkFscanfResult(r);
-                r = fscanf( f, "%lf", &var1[counter] );
-                checkFscanfResult(r);
-                r = fscanf( f, "%lf", &moy2[counter] );
-                checkFscanfResult(r);
-                r = fscanf( f, "%lf", &var2[counter] );
-                checkFscanfResult(r);
-            }
-        }
+    const long nbl = to_classify->getHeight();
+    const long nbc = to_classify->getWidth();
+    // analyse widens the window to 3 pixels at least ; checked here so that a small image of a batch is only reported
+    if(!( std::max(classify_fen, 3) < nbl * 2 && std::max(classify_fen, 3) < nbc * 2 )) {
+        throw "Error in ClassAnalysis::classify:\nthe window is larger than the image";
     }
-    else {
-      // Invalid file type
-        return NULL;
+
+    if( model.type == Model::FEATURES_MAHALANOBIS ) {
+        FeatureStack stack;
+        analyse_features(classify_fen, to_classify->begin(), nbl, nbc, model.features, stack);
+        classif_mahalanobis(stack, model.classes, &returnval);
+        feature_images( stack, returnval_mean, returnval_stdev );
+        return returnval;
     }
 
-    param1 = new double[nbl * nbc ];
-    param2 = new double[nbl * nbc ];
-    uint8_t *im1 = to_classify->begin();
+    const int num_classes = model.classes.size();
+    // classif attend des ecarts-types, le modele garde des variances
+    vector<double> moy1(num_classes), var1(num_classes), moy2(num_classes), var2(num_classes);
+    for(int c = 0; c < num_classes; c++) {
+        moy1[c] = model.classes[c].mean[0];
+        moy2[c] = model.classes[c].mean[1];
+        var1[c] = sqrt(model.classes[c].covariance[0]);
+        var2[c] = sqrt(model.classes[c].covariance[3]);
+    }
+    double *param1 = new double[nbl * nbc];
+    double *param2 = new double[nbl * nbc];
 
-    analyse(classify_fen, im1,param1,param2,nbl,nbc );
-    classif(param1,param2,moy1,var1,moy2,var2,classify_fen,nbl,nbc, &returnval, num_classes );
+    analyse(classify_fen, to_classify->begin(), param1, param2, nbl, nbc );
+    classif(param1, param2, &moy1[0], &var1[0], &moy2[0], &var2[0], classify_fen, nbl, nbc, &returnval, num_classes );
 
     if( returnval_mean != NULL ) {
         (*returnval_mean) = new Image_t<double>(nbc, nbl, 1, param1);
@@ -363,70 +1092,120 @@ Image *ClassAnalysis::classify_from_file( GrayscaleImage *to_classify, FILE *f,
     if( returnval_stdev != NULL ) {
         (*returnval_stdev) = new Image_t<double>(nbc, nbl, 1, param2);
     }
-
-    delete im1;
-    delete param1;
-    delete param2;
-    delete moy1;
-    delete moy2;
-    delete var1;
-    delete var2;
+    delete[] param1;
+    delete[] param2;
     return returnval;
 }
 
+Image *ClassAnalysis::classify_from_file( GrayscaleImage *to_classify, FILE *f, int classify_fen, Image_t<double> **returnval_mean, Image_t<double> **returnval_stdev ) {
+    if(!( to_classify != NULL )) {
+        throw "Error in ClassAnalysis::classify_from_file:\nto_classify = NULL";
+    }
+    if(!( f != NULL )) {
+      throw "Error in ClassAnalysis::classify_from_file:\nf = NULL";
+    }
+
+    Model model;
+    if( !read_model( f, model ) ) {
+        // Invalid file
+        return NULL;
+    }
+    return classify( to_classify, model, classify_fen, returnval_mean, returnval_stdev );
+}
+
+int ClassAnalysis::classify_batch( const Model& model, int classify_fen, const vector<string>& inputs, const vector<string>& outputs, vector<string>& errors ) {
+    if( inputs.size() != outputs.size() ) {
+        throw "Error in ClassAnalysis::classify_batch:\ninputs.size() != outputs.size()";
+    }
+    const int n = inputs.size();
+    errors.assign(n, string());
+    std::atomic<int> suivante(0), nbSauvees(0);
+
+    // un thread par image : chaque thread prend l'image suivante des qu'il a sauve la precedente,
+    // les images pouvant etre de tailles tres differentes ; les boucles paralleles de classify
+    // s'executent alors dans le thread de l'image (Parallel::inParallel)
+    Parallel::forBands(0, std::min(n, Parallel::nbThreads()), [&](int, int) {
+        for(int i = suivante++; i < n; i = suivante++) {
+            try {
+                Image image(inputs[i]);
+                GrayscaleImage* gray = Converter<GrayscaleImage>::convert(image);
+                Image* result = NULL;
+                try {
+                    result = classify( gray, model, classify_fen, NULL, NULL );
+                }
+                catch(...) {
+                    delete gray;
+                    throw;
+                }
+                delete gray;
+                result->save(outputs[i]);
+                delete result;
+                nbSauvees++;
+            }
+            catch(const char* e) {
+                errors[i] = e;
+            }
+            catch(const std::exception& e) {
+                errors[i] = e.what();
+            }
+            catch(...) {
+                errors[i] = "could not read or write the image";
+            }
+        }
+    });
+    return nbSauvees;
+}
+
 string ClassAnalysis::print_file_info( FILE *f ) {
   if(!( f != NULL )) {
         throw "Error in ClassAnalysis::print_file_info:\nf = NULL";
     }
     string returnval;
-
-    int wsize;
-    int num_classes;
     char buffer[255];
-    double moy1, moy2, var1, var2;
-    int counter;
-    int r = fscanf( f, "%s", buffer );
-    checkFscanfResult(r);
-    if( strcmp( buffer, "MEAN_STDEV" ) == 0 ) {
-      r = fscanf( f, "%d", &wsize ); // Old learning window size
-      checkFscanfResult(r);
-        sprintf( buffer, "Learning Window Size: %d\n", wsize );
-        returnval = returnval + buffer;
-        r = fscanf( f, "%d", &num_classes );
-        checkFscanfResult(r);
-        sprintf( buffer, "Number of Classes: %d\n", num_classes );
-        returnval = returnval + buffer;
-
-        if( num_classes <= 0 ) {
-          // Invalid number of classes
-            returnval = "\n      Invalid number of classes";
+    Model model;
+    uint32_t version;
+    if( !read_model_version( f, model, version ) ) {
+        return "Not a valid classification file\n";
+    }
+    if( version > 0 ) {
+        sprintf( buffer, "File format: binary, version %u\n", version );
+    }
+    else {
+        sprintf( buffer, "File format: text\n" );
+    }
+    returnval = returnval + buffer;
+    sprintf( buffer, "Learning Window Size: %d\n", model.fen );
+    returnval = returnval + buffer;
+    sprintf( buffer, "Number of Classes: %lu\n", model.classes.size() );
+    returnval = returnval + buffer;
+
+    if( model.type == Model::FEATURES_MAHALANOBIS ) {
+        const int n = model.features.size();
+        returnval = returnval + "Features (Mahalanobis distance):";
+        for(int k = 0; k < n; k++) {
+            returnval = returnval + (k ? ", " : " ") + featureName(model.features[k]);
         }
-        else {
-            for( counter=0; counter< num_classes; counter++ ) {
-              r = fscanf( f, "%lf", &moy1 );
-              checkFscanfResult(r);
-                r = fscanf( f, "%lf", &var1 );
-                checkFscanfResult(r);
-                r = fscanf( f, "%lf", &moy2 );
-                checkFscanfResult(r);
-                r = fscanf( f, "%lf", &var2 );
-                checkFscanfResult(r);
-              sprintf( buffer, "---- Class %d:\n", (counter+1) );
+        returnval = returnval + "\n\n";
+        for(size_t c = 0; c < model.classes.size(); c++) {
+            sprintf( buffer, "---- Class %lu:\n", (c+1) );
+            returnval = returnval + buffer;
+            for(int k = 0; k < n; k++) {
+                sprintf( buffer, "     Mean of %s: %f (stdev %f)\n", featureName(model.features[k]), model.classes[c].mean[k], sqrt(model.classes[c].covariance[k*n+k]) );
                 returnval = returnval + buffer;
-                sprintf( buffer, "     Mean of means: %f\n", moy1 );
-                returnval = returnval + buffer;
-                //sprintf( buffer, "     Stdev of means: %f\n", var1 );
-                //returnval = returnval + buffer;
-                sprintf( buffer, "     Mean of stdevs: %f\n", moy2 );
-                returnval = returnval + buffer;
-                //sprintf( buffer, "     Stdev of stdevs: %f\n", var2 );
-                //returnval = returnval + buffer;
-                returnval = returnval + "\n";
             }
+            returnval = returnval + "\n";
         }
     }
     else {
-      returnval = "Not a valid classification file\n";
+        for(size_t c = 0; c < model.classes.size(); c++) {
+            sprintf( buffer, "---- Class %lu:\n", (c+1) );
+            returnval = returnval + buffer;
+            sprintf( buffer, "     Mean of means: %f\n", model.classes[c].mean[0] );
+            returnval = returnval + buffer;
+            sprintf( buffer, "     Mean of stdevs: %f\n", model.classes[c].mean[1] );
+            returnval = returnval + buffer;
+            returnval = returnval + "\n";
+        }
     }
 
     return returnval;
@@ -24,15 +24,109 @@
 #include <string>
 #include <vector>
 #include <GrayscaleImage.h>
+#include <cstdio>
 
 namespace ClassAnalysis
 {
+    /**
+     * Summed-area table : somme(x0, y0, x1, y1) is the sum of the values of
+     * the rectangle [x0, x1[ x [y0, y1[ in four reads, whatever its size.
+     */
+    template<typename T>
+    class TableSommes
+    {
+      public:
+        /* valeur(x, y) gives the value of the pixel (x, y), 0 <= x < largeur, 0 <= y < hauteur */
+        template<typename F>
+        TableSommes(int largeur, int hauteur, F valeur) : _largeur(largeur + 1), _t((size_t)(largeur + 1) * (hauteur + 1), T(0)) {
+            for(int y = 0; y < hauteur; ++y) {
+                const T* prec = &_t[(size_t)y * _largeur];
+                T* cour = &_t[(size_t)(y + 1) * _largeur];
+                T ligne = T(0);
+                for(int x = 0; x < largeur; ++x) {
+                    ligne += valeur(x, y);
+                    cour[x + 1] = prec[x + 1] + ligne;
+                }
+            }
+        }
+        T somme(int x0, int y0, int x1, int y1) const {
+            return _t[(size_t)y1 * _largeur + x1] - _t[(size_t)y0 * _largeur + x1]
+                 - _t[(size_t)y1 * _largeur + x0] + _t[(size_t)y0 * _largeur + x0];
+        }
+      private:
+        size_t _largeur;
+        std::vector<T> _t;
+    };
+
+    /* Local features available for the feature stack, all computed over a fen x fen window */
+    enum Feature {
+        MEAN,           // mean of the gray levels
+        STDEV,          // standard deviation of the gray levels
+        ENTROPY,        // entropy (bits) of the histogram of the gray levels on 32 bins
+        GRADIENT,       // mean of the squared Sobel gradient magnitude
+        LAWS_E5L5,      // mean of the absolute Laws E5L5 response (horizontal edges)
+        LAWS_L5E5,      // vertical edges
+        LAWS_S5S5,      // spots
+        LAWS_R5R5,      // ripples
+        NB_FEATURES
+    };
+    const char* featureName(int feature);
+
+    /**
+     * Feature vectors of every pixel in structure-of-arrays layout : plane k
+     * holds the feature features[k] of all the pixels, row after row, so that
+     * the per-pixel loops run over contiguous memory.
+     */
+    struct FeatureStack {
+        int width, height;
+        std::vector<int> features;
+        std::vector<double> data;
+        double* plane(int k) { return &data[(size_t)k * width * height]; }
+        const double* plane(int k) const { return &data[(size_t)k * width * height]; }
+    };
+
+    /* Learned class for the Mahalanobis classification : mean vector and full covariance matrix (row-major) */
+    struct ClassModel {
+        std::vector<double> mean;
+        std::vector<double> covariance;
+    };
+
+    /**
+     * Learned model of a classification file. A MEAN_STDEV model holds, for
+     * each class, the means of the local mean and standard deviation and the
+     * diagonal of their covariance, i.e. their variances (the former text
+     * files store standard deviations and are converted when read) ; a
+     * FEATURES_MAHALANOBIS model holds the full ClassModel of each class for
+     * the features of the stack.
+     */
+    struct Model {
+        enum Type { MEAN_STDEV, FEATURES_MAHALANOBIS };
+        int type;
+        int fen; // learning window size
+        std::vector<int> features;
+        std::vector<ClassModel> classes;
+    };
+
     void analyse(int fen, uint8_t *imorig,double *param1,double *param2,int nbl,int nbc );
+    void analyse_features(int fen, const uint8_t *imorig, int nbl, int nbc, const std::vector<int>& features, FeatureStack& stack);
+    void estimateur_features(const FeatureStack& stack, const std::vector<imagein::Rectangle>& rectangles, std::vector<ClassModel>& classes);
+    void classif_mahalanobis(const FeatureStack& stack, const std::vector<ClassModel>& classes, imagein::Image **classify_result);
+    void kmeans(const FeatureStack& stack, int k, std::vector<ClassModel>& classes, imagein::Image **classify_result);
     void estimateur(double *param1,double *param2,double moy1[],double var1[],double moy2[],double var2[],int fen,int nbl,int nbc, const std::vector<imagein::Rectangle>& rectangles);
     void classif(double *param1,double *param2,double moy1[],double var1[],double moy2[],double var2[],int fen,int nbl,int nbc, imagein::Image **classify_result, int num_classes );
     void write_to_file( imagein::GrayscaleImage *learning, const std::vector<imagein::Rectangle>& rectangles, FILE *f, int learning_fen, imagein::Image_t<double> **returnval_mean, imagein::Image_t<double> **returnval_stdev );
+    void write_features_to_file( imagein::GrayscaleImage *learning, const std::vector<imagein::Rectangle>& rectangles, FILE *f, int learning_fen, const std::vector<int>& features, imagein::Image_t<double> **returnval_mean, imagein::Image_t<double> **returnval_stdev );
+    void kmeans_to_file( imagein::GrayscaleImage *to_cluster, FILE *f, int fen, const std::vector<int>& features, int k, imagein::Image **classify_result, imagein::Image_t<double> **returnval_mean, imagein::Image_t<double> **returnval_stdev );
     void NormalizeRectangle( imagein::Rectangle &rect );
+    /* *returnval_mean and *returnval_stdev are set to NULL when the model does not use that feature */
     imagein::Image *classify_from_file( imagein::GrayscaleImage *to_classify, FILE *f, int classify_fen, imagein::Image_t<double> **returnval_mean, imagein::Image_t<double> **returnval_stdev );
+    /* Binary model file (little-endian, versioned) ; read_model also accepts the former text files */
+    void write_model( FILE *f, const Model& model );
+    bool read_model( FILE *f, Model& model );
+    imagein::Image *classify( imagein::GrayscaleImage *to_classify, const Model& model, int classify_fen, imagein::Image_t<double> **returnval_mean, imagein::Image_t<double> **returnval_stdev );
+    /* Classifies the image files inputs[i] into outputs[i], several images at a time, each result being
+     * saved as soon as it is computed. errors[i] is empty on success. Returns the number of images saved. */
+    int classify_batch( const Model& model, int classify_fen, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs, std::vector<std::string>& errors );
     std::string print_file_info( FILE *f );
 }
 
@@ -1,521 +1,602 @@
 #include "Croissance.h"
-#include <RandomLib/Random.hpp>
+#include <Parallel.h>
 #include <GrayscaleImage.h>
 #include <RgbImage.h>
 #include <QColor>
+#include <algorithm>
+#include <queue>
+#include <stdint.h>
+#include <cmath>
+#include <cstdlib>
 
 using namespace std;
 using namespace imagein;
-using namespace RandomLib;
 
 Croissance::Croissance()
 {
 	tabin = NULL;
-	tabout = NULL;
-	tablabel = NULL;
-	MoyCell = NULL;
-	NbPointCell = 0;
-	tab_min_ij = NULL;
+	nbc = nbl = size = 0;
+	seuil = 0;
 }
 
 Croissance::~Croissance()
 {
 }
 
-int Croissance::croissance1a( const Image *im, int threshhold, Image **luminance, Image **colorRgn ) {
-
-   // Random random;
-    NbPointCell=0;
+void Croissance::init(const Image *im, int threshhold)
+{
+    init(im->begin(), im->getWidth(), im->getHeight(), threshhold);
+}
 
-    int seuil;
-    int numregion;
-    long nbpregion;
-    int lum = 0;
-    float somlum;
-  
+void Croissance::init(const Image::depth_t *tab, long largeur, long hauteur, int threshhold)
+{
     seuil = threshhold;
-    nbc = im->getWidth(); // nombre de colonnes de l'image d'entrée
-    nbl = im->getHeight(); // nombre de lignes de l'image d'entrée
+    nbc = largeur; // nombre de colonnes de l'image d'entrée
+    nbl = hauteur; // nombre de lignes de l'image d'entrée
     size = nbc * nbl; // taille de l'image
+    tabin = tab;
 
-//    BasicImageFun bif;
-    tabin = im->begin();
-
-    tabout = new Image::depth_t[size*sizeof(Image::depth_t)]; // tableau de valeurs pour l'image de sortie (luminance) [0 ; size[
-    tablabel = new int[size*sizeof(int)]; // tableau des numéros de régions pour chaque pixel de l'image [0 ; size[
-    MoyCell = new int[size*sizeof(int)]; // tableau des valeurs moyenne des pixels par régions [0 ; numregion[
-		
-//	 initialisation de tablabel a zero (nécessaire ?)
-	for (int i = 0; i < size; i++) {
-		tablabel[i] = 0;
-	}
-
-	// initialisation des paramètres
-    numregion=0 ; // aucune région créée au début de l'algorithme
-    nbpregion=0 ; // aucun pixel dans la région courante au début de l'algorithme
-    somlum=0; // luminance cumulée des pixels dans la région couratne nulle au début de l'algorithme
-
-    for(int i=0 ; i<nbl ; i++)
-        for(int j=0 ; j<nbc ; j++)
-        {
-            if(tablabel[i*nbc+j] == 0) // si le pixel courant n'appartient pas a une region
-            {
-				// On cree une nouvelle region
-                numregion++;
-                MoyCell[numregion] = 0;
-                pushItem(i,j,seuil,numregion,somlum,nbpregion,lum);//on ajoute le pixel dans la pile des candidats (ce sera la seed)
-                while( !croi_stack.empty() ) {
-                    parcours_parcelle1A(); //ajoute les pixels qui valident le critère dans la région, et les pixels voisins dans la pile des candidats
-                } // while : on sort de cette boucle quand la région est complète (pile de candidats vide)
-				//numregion++;
-                MoyCell[numregion] = MoyCell[numregion]/NbPointCell; // calcul de la luminance moyenne des pixels dans la région
-            } // if : fin de la création de la région liée au pixel courant
-			// on réinitialise les paramètres pour la création de la prochaine région
-            NbPointCell = 0;
-            somlum=0;
-            nbpregion=0;
-			// on ne réinitialise pas lum ? (entier passé en paramètre pour la création d'un stackitem)
-        }// for : parcours de l'image d'entrée
-	
-	// remplissage de tabout
-	for (int i = 0; i < size; i++)
-		// chaque pixel de l'image de sortie prend la valeur de la valeur moyenne des pixels de la région à laquelle il appartient
-		 tablabel[i] < size ? tabout[i] = MoyCell[tablabel[i]] : tabout[i] = 0;
-	//	tabout[i] = MoyCell[tablabel[i]];
-
-	// Construction de l'image de sortie en luminance (en utilisant les valeurs de tabout)
-    *luminance = new GrayscaleImage(nbc, nbl, tabout);
-
-	RgbImage* ic = new RgbImage(nbc, nbl);
-	for (int j = 0; j<nbl; j++) {
-		for (int i = 0; i<nbc; i++) {
-			int n = tablabel[j*nbc + i] - 1; /* € [0, numregion[ */
-			const int nhue = 360;
-			const int ngrad = ceil((double)numregion / (double)nhue);
-			const int hue = floor(n * nhue / numregion); /* € [0, nhue[ */
-			const int grad = n - ceil((double)hue * (double)numregion / (double)nhue); /* € [0, ngrad[ */
-			if (grad < 0 || grad >= ngrad) {
-				cout << "grad = " << grad << endl;
-			}
-			QColor color = QColor::fromHsl(hue, 255, (grad + 1) * 255 / (ngrad + 1));
-			ic->setPixel(i, j, 0, color.red());
-			ic->setPixel(i, j, 1, color.green());
-			ic->setPixel(i, j, 2, color.blue());
-		}
-	}
+    tablabel.assign(size, 0); // aucun pixel n'appartient a une région au début de l'algorithme
+    MoyCell.assign(size + 1, 0); // les numéros de régions vont de 1 à size au plus
+    croi_stack.clear();
+    chemins.clear();
+}
 
-    *colorRgn = ic;
+int Croissance::croissance1a( const Image *im, int threshhold, Image **luminance, Image **colorRgn ) {
 
+    init(im, threshhold);
 
-    tabin = NULL;
-    delete[] tabout;
-    delete[] tablabel;
-    delete[] MoyCell;
-    tabout = NULL;
-    tablabel = NULL;
-    MoyCell = NULL;
+    int numregion = 0; // aucune région créée au début de l'algorithme
+    for(int p = 0; p < size; p++)
+    {
+        if(tablabel[p] == 0) // si le pixel courant n'appartient pas a une region
+        {
+            // On cree une nouvelle region a partir de ce germe
+            numregion++;
+            parcours_parcelle1A(p, numregion);
+        }
+    }
 
+    sortie(numregion, luminance, colorRgn);
     return numregion;
 }
 
-void Croissance::parcours_parcelle1A()
+/* Empile les voisins du pixel index (droite, bas, gauche, haut) avec l'état
+ * du pixel qui les empile. */
+void Croissance::pushVoisins(int index, int chemin)
 {
-     if( croi_stack.empty() ) {
-        throw("Error in Croissance::parcours_parcelle1B:\ncroi_stack.empty() = TRUE");
-    }
-
-	// on dépile un élément
+    const int i = index / nbc;
+    const int j = index - i * nbc;
     croi_stackitem csi;
-    csi = croi_stack.back();
-    croi_stack.pop_back();
-
-    int i = csi.i;
-    int j = csi.j;
-    int seuil = csi.seuil;
-    int numregion = csi.numregion;
-    float somlum = csi.somlum;
-    int nbpregion = csi.nbpregion;
-    int lum = csi.lum;
-
-	// si le pixel dépilé est le premier pixel de la region
-    if(nbpregion == 0)
+    csi.chemin = chemin;
+    if(j<nbc-1) { csi.index = index + 1; croi_stack.push_back(csi); }
+    if(i<nbl-1) { csi.index = index + nbc; croi_stack.push_back(csi); }
+    if(j>0) { csi.index = index - 1; croi_stack.push_back(csi); }
+    if(i>0) { csi.index = index - nbc; croi_stack.push_back(csi); }
+}
+
+/* Croissance en profondeur avec le critère | current - mean | < threshold.
+ * La moyenne est celle des pixels du chemin qui relie le candidat au germe
+ * (état du pixel qui l'a empilé) : l'ordre de parcours (pile LIFO)
+ * conditionne donc le résultat. Chaque candidat ne porte que son indice et
+ * celui de cet état, stocké une seule fois par pixel ajouté. */
+void Croissance::parcours_parcelle1A(int germe, int numregion)
+{
+    long long somme = tabin[germe];
+    long long nbpregion = 1;
+
+    // le germe est toujours ajouté a la région
+    tablabel[germe] = numregion;
+    croi_chemin etat;
+    etat.somlum = tabin[germe];
+    etat.nbpregion = 1;
+    chemins.clear();
+    chemins.push_back(etat);
+    croi_stack.clear();
+    pushVoisins(germe, 0);
+
+    while(!croi_stack.empty())
     {
-		// on ajoute le pixel a la region
-        tablabel[i*nbc+j] = numregion;
-        MoyCell[numregion] += tabin[i*nbc+j] ;
-        NbPointCell ++ ;
-        somlum += tabin[i*nbc+j];
-        lum = tabin[i*nbc+j] ; // remplace la valeur de csi.lum (=0 au début de l'algorithme, puis a la valeur précédente de tabin[i*nbc+j]
-        nbpregion++;
-
-		// on empile les pixels voisins (s'ils existent)
-        if(j<nbc-1) pushItem(i,j+1,seuil,numregion,somlum,nbpregion,lum);
-        if(i<nbl-1) pushItem(i+1,j,seuil,numregion,somlum,nbpregion,lum);
-        if(j>0) pushItem(i,j-1,seuil,numregion,somlum,nbpregion,lum);
-        if(i>0) pushItem(i-1,j,seuil,numregion,somlum,nbpregion,lum);
+        // on dépile un élément
+        const croi_stackitem csi = croi_stack.back();
+        croi_stack.pop_back();
+        const int p = csi.index;
+        if(tablabel[p] != 0) continue; // le pixel appartient déjà a une région
+
+        const croi_chemin parent = chemins[csi.chemin];
+        if(fabs((double)(tabin[p] - parent.somlum / parent.nbpregion)) < (double)(seuil)) // | current - mean | < threshold
+        {
+            // on ajoute le pixel a la region et on empile ses voisins
+            tablabel[p] = numregion;
+            somme += tabin[p];
+            nbpregion++;
+            etat.somlum = parent.somlum + tabin[p];
+            etat.nbpregion = parent.nbpregion + 1;
+            chemins.push_back(etat);
+            pushVoisins(p, chemins.size() - 1);
+        }
     }
-	// si le pixel dépilé est candidat
-    else if(fabs((double)(tabin[i*nbc+j]-somlum/nbpregion)) < (double)(seuil) && tablabel[i*nbc+j]==0) // | current - mean | < threshold && pixel n'appartient pas a une région
-    {
-		// on ajoute le pixel a la region (s'ils existent)
-        tablabel[i*nbc+j] = numregion;
-        MoyCell[numregion] += tabin[i*nbc+j] ;
-        NbPointCell ++ ;
-        somlum += tabin[i*nbc+j];
-        nbpregion++;
-
-		// on empile les pixels voisins (si on est pas au bord de l'image)
-        if(j<nbc-1) pushItem(i,j+1,seuil,numregion,somlum,nbpregion,lum);
-        if(i<nbl-1) pushItem(i+1,j,seuil,numregion,somlum,nbpregion,lum);
-        if(j>0) pushItem(i,j-1,seuil,numregion,somlum,nbpregion,lum);
-        if(i>0) pushItem(i-1,j,seuil,numregion,somlum,nbpregion,lum);
-  }
+
+    MoyCell[numregion] = somme / nbpregion; // luminance moyenne des pixels dans la région
 }
 
 int Croissance::croissance1b( const Image *im, int threshhold, Image **luminance, Image **colorRgn  ) {
-    Random random;
-    NbPointCell=0;
-
-    int seuil;
-    int numregion;
-    long nbpregion;
-    int lum = 0;
-    float somlum;
-
-    seuil = threshhold;
-    nbc = im->getWidth();
-    nbl = im->getHeight();
-    size = nbc * nbl;
-
-//    BasicImageFun bif;
-    tabin = im->begin();
-
-    tabout = new Image::depth_t[size];
-    tablabel = new int[size];
-    MoyCell = new int[size];
 
-    numregion=1 ;
-    nbpregion=0 ;
-    somlum=0;
+    init(im, threshhold);
 
-    for(int i=0 ; i<nbl ; i++)
-        for(int j=0 ; j<nbc ; j++)
+    int numregion = 0;
+    for(int p = 0; p < size; p++)
+    {
+        if(tablabel[p] == 0)
         {
-            if(tablabel[i*nbc+j] == 0)
-            {
-                MoyCell[numregion] = 0;
-                pushItem(i,j,seuil,numregion,somlum,nbpregion,lum);
-                while( !croi_stack.empty() ) {
-                    parcours_parcelle1B();
-                }
-                MoyCell[numregion] = MoyCell[numregion]/NbPointCell;
-                numregion++;
-            }
-
-            NbPointCell = 0;
-            somlum=0;
-            nbpregion=0;
+            numregion++;
+            parcours_parcelle1B(p, numregion);
         }
+    }
 
-    for(int i=0 ; i<size ; i++)
-        tabout[i] = MoyCell[tablabel[i]];
+    sortie(numregion, luminance, colorRgn);
+    return numregion;
+}
 
+/* Croissance avec le critère | current - initial | < threshold.
+ * Le critère ne dépend pas de l'ordre de parcours : la région est la composante
+ * connexe du germe, remplie segment par segment. La pile ne contient qu'un
+ * pixel par segment candidat des lignes voisines. */
+void Croissance::parcours_parcelle1B(int germe, int numregion)
+{
+    const int lum = tabin[germe];
+    long long somme = 0;
+    long long nbpregion = 0;
+    int *label = &tablabel[0];
 
+    croi_stack.clear();
+    croi_stackitem csi;
+    csi.index = germe;
+    csi.chemin = 0;
+    croi_stack.push_back(csi);
 
-    *luminance = new GrayscaleImage(nbc, nbl, tabout);
+    while(!croi_stack.empty())
+    {
+        const int p = croi_stack.back().index;
+        croi_stack.pop_back();
+        if(label[p] != 0) continue; // segment déjà rempli
+
+        // extension du segment a gauche et a droite
+        const int i = p / nbc;
+        const int ligne = i * nbc;
+        int g = p - ligne, d = g;
+        while(g > 0 && label[ligne+g-1] == 0 && abs(tabin[ligne+g-1] - lum) < seuil) g--;
+        while(d < nbc-1 && label[ligne+d+1] == 0 && abs(tabin[ligne+d+1] - lum) < seuil) d++;
+        for(int j = g; j <= d; j++) {
+            label[ligne+j] = numregion;
+            somme += tabin[ligne+j];
+        }
+        nbpregion += d - g + 1;
 
-    RgbImage* ic = new RgbImage(nbc, nbl);
-    for(int j=0 ; j<nbl ; j++) {
-        for(int i=0 ; i<nbc ; i++) {
-            int n = tablabel[j*nbc + i] - 1; /* € [0, numregion[ */
-            const int nhue = 360;
-            const int ngrad = ceil((double)numregion / (double)nhue);
-            const int hue = floor(n * nhue / numregion); /* € [0, nhue[ */
-            const int grad = n - ceil((double)hue * (double)numregion / (double)nhue); /* € [0, ngrad[ */
-            if(grad < 0 || grad >= ngrad) {
-                cout << "grad = " << grad << endl;
+        // un candidat par segment sur les lignes du dessus et du dessous
+        for(int v = i - 1; v <= i + 1; v += 2)
+        {
+            if(v < 0 || v >= nbl) continue;
+            const int voisine = v * nbc;
+            bool dansSegment = false;
+            for(int j = g; j <= d; j++) {
+                if(label[voisine+j] == 0 && abs(tabin[voisine+j] - lum) < seuil) {
+                    if(!dansSegment) {
+                        csi.index = voisine + j;
+                        croi_stack.push_back(csi);
+                        dansSegment = true;
+                    }
+                }
+                else dansSegment = false;
             }
-            QColor color = QColor::fromHsl(hue, 255, (grad + 1) * 255 / (ngrad + 1));
-            ic->setPixel(i, j, 0, color.red());
-            ic->setPixel(i, j, 1, color.green());
-            ic->setPixel(i, j, 2, color.blue());
         }
     }
 
-    *colorRgn = ic;
+    MoyCell[numregion] = somme / nbpregion;
+}
 
+int Croissance::croissance2a( const Image *im, int threshhold, Image **luminance, Image **colorRgn  ) {
 
-    tabin = NULL;
-    delete tabout;
-    delete tablabel;
-   // delete MoyCell;
-    tabout = NULL;
-    tablabel = NULL;
-    MoyCell = NULL;
+    init(im, threshhold);
 
-    return numregion;
-}
+    std::vector<int> tab_min(size);
+    find_min(&tab_min[0]);
 
-void Croissance::parcours_parcelle1B() {
-     if( croi_stack.empty() ) {
-        throw("Error in Croissance::parcours_parcelle1B:\ncroi_stack.empty() = TRUE");
-    }
-    croi_stackitem csi;
-    csi = croi_stack.back();
-    croi_stack.pop_back();
-    int i = csi.i;
-    int j = csi.j;
-    int seuil = csi.seuil;
-    int numregion = csi.numregion;
-    float somlum = csi.somlum;
-    int nbpregion = csi.nbpregion;
-    int lum = csi.lum;
-
-    if(nbpregion == 0)
+    int numregion = 0;
+    for(int k = 0; k < size; k++)
     {
-        tablabel[i*nbc+j] = numregion;
-        MoyCell[numregion] += tabin[i*nbc+j] ;
-        NbPointCell ++ ;
-        somlum += tabin[i*nbc+j];
-        lum = tabin[i*nbc+j] ;
-        nbpregion++;
-        if(j<nbc-1) pushItem(i,j+1,seuil,numregion,somlum,nbpregion,lum);
-        if(i<nbl-1) pushItem(i+1,j,seuil,numregion,somlum,nbpregion,lum);
-        if(j>0) pushItem(i,j-1,seuil,numregion,somlum,nbpregion,lum);
-        if(i>0) pushItem(i-1,j,seuil,numregion,somlum,nbpregion,lum);
+        const int p = tab_min[k];
+        if(tablabel[p] == 0)
+        {
+            numregion++;
+            parcours_parcelle1A(p, numregion);
+        }
     }
-    else if(fabs((double)(tabin[i*nbc+j]-lum)) < (double)(seuil) && tablabel[i*nbc+j]==0)
-    {
-        tablabel[i*nbc+j] = numregion;
-        MoyCell[numregion] += tabin[i*nbc+j] ;
-        NbPointCell ++ ;
-        somlum += tabin[i*nbc+j];
-        nbpregion++;
-        if(j<nbc-1) pushItem(i,j+1,seuil,numregion,somlum,nbpregion,lum);
-        if(i<nbl-1) pushItem(i+1,j,seuil,numregion,somlum,nbpregion,lum);
-        if(j>0) pushItem(i,j-1,seuil,numregion,somlum,nbpregion,lum);
-        if(i>0) pushItem(i-1,j,seuil,numregion,somlum,nbpregion,lum);
-  }
-}
 
-int Croissance::croissance2a( const Image *im, int threshhold, Image **luminance, Image **colorRgn  ) {
-    Random random;
-    NbPointCell=0;
+    sortie(numregion, luminance, colorRgn);
+    return numregion;
+}
 
-    int seuil;
-    int numregion;
-    long nbpregion;
-    int lum = 0;
-    float somlum;
+int Croissance::croissance2b( const Image *im, int threshhold, Image **luminance, Image **colorRgn  ) {
 
-    seuil = threshhold;
-    nbc = im->getWidth();
-    nbl = im->getHeight();
-    size = nbc * nbl;
+    init(im, threshhold);
 
-//    BasicImageFun bif;
-    tabin = im->begin();
+    std::vector<int> tab_min(size);
+    find_min(&tab_min[0]);
 
-    tabout = new Image::depth_t[size];
-    tablabel = new int[size];
-    MoyCell = new int[size];
+    int numregion = 0;
+    for(int k = 0; k < size; k++)
+    {
+        const int p = tab_min[k];
+        if(tablabel[p] == 0)
+        {
+            numregion++;
+            parcours_parcelle1B(p, numregion);
+        }
+    }
 
-    numregion=1 ;
-    nbpregion=0 ;
-    somlum=0;
-    int min_i, min_j ,*tab_min_ij;
-    tab_min_ij = new int[2*size];
-    find_min(tab_min_ij) ;
+    sortie(numregion, luminance, colorRgn);
+    return numregion;
+}
 
+/* Etiquette toute l'image courante (numéros de région a partir de 1), les
+ * germes étant pris dans l'ordre du balayage ou par luminance croissante. */
+int Croissance::croissanceTuile(bool germeMin, bool critereMoyenne)
+{
+    std::vector<int> germes;
+    if(germeMin) {
+        germes.resize(size);
+        find_min(&germes[0]);
+    }
 
-    int i = 0 ;
-    do
+    int numregion = 0;
+    for(int k = 0; k < size; k++)
     {
-        min_i = tab_min_ij[i];
-        min_j = tab_min_ij[i+1];
-
-        if(tablabel[min_i*nbc+min_j] == 0)
+        const int p = germeMin ? germes[k] : k;
+        if(tablabel[p] == 0)
         {
             numregion++;
-            pushItem(min_i,min_j,seuil,numregion,somlum,nbpregion,lum);
-            while( !croi_stack.empty()) {
-                parcours_parcelle1A();
-            }
-            MoyCell[numregion] = MoyCell[numregion]/NbPointCell;
+            if(critereMoyenne) parcours_parcelle1A(p, numregion);
+            else parcours_parcelle1B(p, numregion);
         }
+    }
+    return numregion;
+}
 
-        NbPointCell = 0;
-        somlum=0;
-        nbpregion=0;
-        i +=2 ;
-    }while(i < 2*size);
-
-    for(int i=0 ; i<size ; i++)
-        tabout[i] = MoyCell[tablabel[i]];
-
-    *luminance = new GrayscaleImage(nbc, nbl, tabout);
+namespace {
+    // union-find sur les numéros de régions, la racine est le plus petit numéro de l'ensemble
+    int racine(std::vector<int>& parent, int r) {
+        while(parent[r] != r) {
+            parent[r] = parent[parent[r]];
+            r = parent[r];
+        }
+        return r;
+    }
+}
 
-    RgbImage* ic = new RgbImage(nbc, nbl);
-    for(int j=0 ; j<nbl ; j++) {
-        for(int i=0 ; i<nbc ; i++) {
-            int n = tablabel[j*nbc + i] - 1; /* € [0, numregion[ */
-            const int nhue = 360;
-            const int ngrad = ceil((double)numregion / (double)nhue);
-            const int hue = floor(n * nhue / numregion); /* € [0, nhue[ */
-            const int grad = n - ceil((double)hue * (double)numregion / (double)nhue); /* € [0, ngrad[ */
-            if(grad < 0 || grad >= ngrad) {
-                cout << "grad = " << grad << endl;
+/* Chaque tuile de TAILLE_TUILE x TAILLE_TUILE pixels est segmentée
+ * indépendamment (une tuile par tâche). Les régions qui se touchent de part et
+ * d'autre d'un bord de tuile sont ensuite fusionnées si la moyenne de chacune
+ * est a moins de threshold de la moyenne de leur union. Le découpage et
+ * l'ordre des fusions ne dépendent pas du nombre de threads : le résultat est
+ * déterministe. */
+int Croissance::croissanceTuiles( const Image *im, int threshhold, bool germeMin, bool critereMoyenne, Image **luminance, Image **colorRgn ) {
+
+    const int T = TAILLE_TUILE;
+    init(im, threshhold);
+    const int nbTx = (nbc + T - 1) / T;
+    const int nbTy = (nbl + T - 1) / T;
+    const int nbTuiles = nbTx * nbTy;
+    int *label = &tablabel[0];
+
+    // 1. croissance dans chaque tuile, numéros locaux dans tablabel
+    std::vector<std::vector<long long> > sommes(nbTuiles);
+    std::vector<std::vector<int> > nombres(nbTuiles);
+    Parallel::forBands(0, nbTuiles, [&](int debut, int fin) {
+        Croissance tuile;
+        std::vector<Image::depth_t> pixels;
+        for(int t = debut; t < fin; t++) {
+            const int x0 = (t % nbTx) * T, y0 = (t / nbTx) * T;
+            const int w = std::min<int>(T, nbc - x0), h = std::min<int>(T, nbl - y0);
+            pixels.resize(w * h);
+            for(int y = 0; y < h; y++)
+                std::copy(tabin + (y0 + y) * nbc + x0, tabin + (y0 + y) * nbc + x0 + w, &pixels[y * w]);
+            tuile.init(&pixels[0], w, h, seuil);
+            const int n = tuile.croissanceTuile(germeMin, critereMoyenne);
+
+            std::vector<long long>& somme = sommes[t];
+            std::vector<int>& nombre = nombres[t];
+            somme.assign(n + 1, 0);
+            nombre.assign(n + 1, 0);
+            for(int y = 0; y < h; y++) {
+                const int *l = &tuile.tablabel[y * w];
+                const Image::depth_t *v = &pixels[y * w];
+                int *dst = label + (y0 + y) * nbc + x0;
+                for(int x = 0; x < w; x++) {
+                    dst[x] = l[x];
+                    somme[l[x]] += v[x];
+                    nombre[l[x]]++;
+                }
             }
-            QColor color = QColor::fromHsl(hue, 255, (grad + 1) * 255 / (ngrad + 1));
-            ic->setPixel(i, j, 0, color.red());
-            ic->setPixel(i, j, 1, color.green());
-            ic->setPixel(i, j, 2, color.blue());
         }
+    });
+
+    // 2. numérotation globale : décalage de chaque tuile dans l'ordre des tuiles
+    std::vector<int> decalage(nbTuiles + 1, 0);
+    for(int t = 0; t < nbTuiles; t++)
+        decalage[t + 1] = decalage[t] + (int)nombres[t].size() - 1;
+    const int nbRegions = decalage[nbTuiles];
+    std::vector<long long> somme(nbRegions + 1, 0);
+    std::vector<long long> nombre(nbRegions + 1, 0);
+    std::vector<int> parent(nbRegions + 1);
+    for(int t = 0; t < nbTuiles; t++) {
+        for(size_t r = 1; r < nombres[t].size(); r++) {
+            somme[decalage[t] + r] = sommes[t][r];
+            nombre[decalage[t] + r] = nombres[t][r];
+        }
+        std::vector<long long>().swap(sommes[t]);
+        std::vector<int>().swap(nombres[t]);
     }
+    for(int r = 0; r <= nbRegions; r++) parent[r] = r;
+
+    // 3. fusion le long des bords de tuiles (bords verticaux puis horizontaux, dans l'ordre du balayage)
+    auto global = [&](int x, int y) {
+        return decalage[(y / T) * nbTx + x / T] + label[y * nbc + x];
+    };
+    auto fusion = [&](int a, int b) {
+        a = racine(parent, a);
+        b = racine(parent, b);
+        if(a == b) return;
+        const double moyA = (double)somme[a] / nombre[a];
+        const double moyB = (double)somme[b] / nombre[b];
+        const double moy = (double)(somme[a] + somme[b]) / (nombre[a] + nombre[b]);
+        if(fabs(moyA - moy) < seuil && fabs(moyB - moy) < seuil) {
+            if(b < a) std::swap(a, b);
+            parent[b] = a;
+            somme[a] += somme[b];
+            nombre[a] += nombre[b];
+        }
+    };
+    for(int y = 0; y < nbl; y++)
+        for(int x = T; x < nbc; x += T)
+            fusion(global(x - 1, y), global(x, y));
+    for(int y = T; y < nbl; y += T)
+        for(int x = 0; x < nbc; x++)
+            fusion(global(x, y - 1), global(x, y));
+
+    // 4. numéros finaux dans l'ordre des régions de tuiles, moyenne des régions fusionnées
+    std::vector<int> numero(nbRegions + 1, 0);
+    int numregion = 0;
+    for(int r = 1; r <= nbRegions; r++) {
+        const int a = racine(parent, r);
+        if(numero[a] == 0) {
+            numero[a] = ++numregion;
+            MoyCell[numregion] = somme[a] / nombre[a];
+        }
+        numero[r] = numero[a];
+    }
+    Parallel::forBands(0, nbl, [&](int debut, int fin) {
+        for(int y = debut; y < fin; y++) {
+            const int *d = &decalage[(y / T) * nbTx];
+            int *l = label + y * nbc;
+            for(int x = 0; x < nbc; x++)
+                l[x] = numero[d[x / T] + l[x]];
+        }
+    });
 
-    *colorRgn = ic;
-
-
-    tabin = NULL;
-    delete[] tabout;
-    delete[] tablabel;
-    delete[] MoyCell;
-    tabout = NULL;
-    tablabel = NULL;
-    MoyCell = NULL;
-
-    delete[] tab_min_ij;
-    tab_min_ij = NULL;
-
+    sortie(numregion, luminance, colorRgn);
     return numregion;
-
 }
 
-int Croissance::croissance2b( const Image *im, int threshhold, Image **luminance, Image **colorRgn  ) {
-    Random random;
-    NbPointCell=0;
+namespace {
+    // arête du graphe d'adjacence des régions, a < b, versions des deux régions quand le coût a été calculé
+    struct croi_arete {
+        double cout;
+        int a, b;
+        int va, vb;
+    };
+    // ordre de la file de priorité : plus petit coût d'abord, puis plus petits numéros
+    struct plusGrandCout {
+        bool operator()(const croi_arete& x, const croi_arete& y) const {
+            if(x.cout != y.cout) return x.cout > y.cout;
+            if(x.a != y.a) return x.a > y.a;
+            return x.b > y.b;
+        }
+    };
+}
 
-    int seuil;
-    int numregion;
-    long nbpregion;
-    int lum = 0;
-    float somlum;
+/* Graphe d'adjacence des régions de tablabel (nombre de pixels, somme et somme
+ * des carrés par région) puis fusion gloutonne des régions voisines, la paire
+ * dont la fusion augmente le moins la somme des carrés des écarts à la moyenne
+ * en premier. Deux régions ne sont fusionnées que si leurs moyennes diffèrent
+ * de moins de seuilFusion (pas de contrainte si seuilFusion <= 0), et la fusion
+ * s'arrête a nbRegionsCible régions (pas de cible si nbRegionsCible <= 0).
+ * La file contient des arêtes périmées après une fusion : elles sont
+ * recalculées au moment où elles sortent de la file. Une arête refusée par
+ * seuilFusion est gardée par ses deux régions et remise dans la file dès que
+ * l'une d'elles est fusionnée, sa moyenne ayant changé. */
+int Croissance::fusionRegions( const Image *im, int numregion, int seuilFusion, int nbRegionsCible, Image **luminance, Image **colorRgn ) {
 
-    seuil = threshhold;
     nbc = im->getWidth();
     nbl = im->getHeight();
     size = nbc * nbl;
-
-//    BasicImageFun bif;
+    if((long)tablabel.size() != size) {
+        throw "Error in Croissance::fusionRegions:\nthe image has not been segmented";
+    }
     tabin = im->begin();
-
-    tabout = new Image::depth_t[size];
-    tablabel = new int[size];
-    MoyCell = new int[size];
-
-    numregion=1 ;
-    nbpregion=0 ;
-    somlum=0;
-    int min_i, min_j ,*tab_min_ij;
-    tab_min_ij = new int[2*size];
-    find_min(tab_min_ij) ;
-
-
-    int i = 0 ;
-    do
+    const int *label = &tablabel[0];
+
+    // statistiques des régions
+    std::vector<long long> nombre(numregion + 1, 0), somme(numregion + 1, 0), carres(numregion + 1, 0);
+    for(int p = 0; p < size; p++) {
+        const int l = label[p];
+        const int v = tabin[p];
+        nombre[l]++;
+        somme[l] += v;
+        carres[l] += v * v;
+    }
+    int nbRegions = 0;
+    for(int r = 1; r <= numregion; r++)
+        if(nombre[r] > 0) nbRegions++;
+
+    // arêtes : paires de régions voisines (4-connexité), sans doublons
+    std::vector<uint64_t> cles;
+    for(int i = 0; i < nbl; i++) {
+        const int *l = label + i * nbc;
+        for(int j = 0; j < nbc; j++) {
+            if(j < nbc - 1 && l[j] != l[j+1])
+                cles.push_back(((uint64_t)std::min(l[j], l[j+1]) << 32) | (uint32_t)std::max(l[j], l[j+1]));
+            if(i < nbl - 1 && l[j] != l[j+nbc])
+                cles.push_back(((uint64_t)std::min(l[j], l[j+nbc]) << 32) | (uint32_t)std::max(l[j], l[j+nbc]));
+        }
+    }
+    std::sort(cles.begin(), cles.end());
+    cles.erase(std::unique(cles.begin(), cles.end()), cles.end());
+
+    std::vector<int> parent(numregion + 1), version(numregion + 1, 0);
+    for(int r = 0; r <= numregion; r++) parent[r] = r;
+    // voisins dont la fusion a été refusée par seuilFusion, par région
+    std::vector<std::vector<int> > refusees(seuilFusion > 0 ? numregion + 1 : 0);
+
+    // augmentation de la somme des carrés des écarts si a et b sont fusionnées
+    auto arete = [&](int a, int b) {
+        const double n = (double)(nombre[a] + nombre[b]);
+        const double s = (double)(somme[a] + somme[b]);
+        croi_arete e;
+        e.cout = ((double)(carres[a] + carres[b]) - s * s / n)
+               - ((double)carres[a] - (double)somme[a] * somme[a] / nombre[a])
+               - ((double)carres[b] - (double)somme[b] * somme[b] / nombre[b]);
+        e.a = a;
+        e.b = b;
+        e.va = version[a];
+        e.vb = version[b];
+        return e;
+    };
+
+    std::priority_queue<croi_arete, std::vector<croi_arete>, plusGrandCout> file;
+    for(size_t k = 0; k < cles.size(); k++)
+        file.push(arete((int)(cles[k] >> 32), (int)(cles[k] & 0xFFFFFFFF)));
+    std::vector<uint64_t>().swap(cles);
+
+    while(!file.empty() && nbRegions > nbRegionsCible)
     {
-        min_i = tab_min_ij[i];
-        min_j = tab_min_ij[i+1];
+        const croi_arete e = file.top();
+        file.pop();
+        const int a = racine(parent, e.a);
+        const int b = racine(parent, e.b);
+        if(a == b) continue;
+        if(a != e.a || b != e.b || version[a] != e.va || version[b] != e.vb) {
+            // arête périmée : une des deux régions a été fusionnée depuis
+            file.push(arete(std::min(a, b), std::max(a, b)));
+            continue;
+        }
+        if(seuilFusion > 0 && fabs((double)somme[a] / nombre[a] - (double)somme[b] / nombre[b]) >= seuilFusion) {
+            refusees[a].push_back(b);
+            refusees[b].push_back(a);
+            continue;
+        }
 
-        if(tablabel[min_i*nbc+min_j] == 0)
-        {
-            numregion++;
-            pushItem(min_i,min_j,seuil,numregion,somlum,nbpregion,lum);
-            while( !croi_stack.empty()) {
-                parcours_parcelle1B();
+        parent[b] = a;
+        nombre[a] += nombre[b];
+        somme[a] += somme[b];
+        carres[a] += carres[b];
+        version[a]++;
+        nbRegions--;
+        if(seuilFusion > 0) {
+            // la moyenne de a a changé : les fusions refusées à a ou à b sont réévaluées
+            std::vector<int>& voisins = refusees[a];
+            voisins.insert(voisins.end(), refusees[b].begin(), refusees[b].end());
+            std::vector<int>().swap(refusees[b]);
+            for(size_t k = 0; k < voisins.size(); k++) {
+                const int v = racine(parent, voisins[k]);
+                if(v != a) file.push(arete(std::min(a, v), std::max(a, v)));
             }
-            MoyCell[numregion] = MoyCell[numregion]/NbPointCell;
+            std::vector<int>().swap(voisins);
         }
+    }
 
-        NbPointCell = 0;
-        somlum=0;
-        nbpregion=0;
-        i +=2 ;
-    }while(i < 2*size);
+    // renumérotation dans l'ordre des régions, moyenne des régions fusionnées
+    std::vector<int> numero(numregion + 1, 0);
+    MoyCell.assign(numregion + 2, 0);
+    int nouveau = 0;
+    for(int r = 1; r <= numregion; r++) {
+        if(nombre[r] == 0) continue;
+        const int a = racine(parent, r);
+        if(numero[a] == 0) {
+            numero[a] = ++nouveau;
+            MoyCell[nouveau] = somme[a] / nombre[a];
+        }
+        numero[r] = numero[a];
+    }
+    for(int p = 0; p < size; p++)
+        tablabel[p] = numero[tablabel[p]];
 
-    for(int i=0 ; i<size ; i++)
-        tabout[i] = MoyCell[tablabel[i]];
+    sortie(nouveau, luminance, colorRgn);
+    return nouveau;
+}
 
-    *luminance = new GrayscaleImage(nbc, nbl, tabout);
+/* Construit les images de sortie : luminance moyenne de chaque région et
+ * une couleur par région. Les couleurs ne dépendent que du numéro de région :
+ * elles sont calculées une fois par région dans une table. */
+void Croissance::sortie(int numregion, Image **luminance, Image **colorRgn)
+{
+    if(luminance == NULL || colorRgn == NULL) {
+        // segmentation seule, avant fusionRegions
+        tabin = NULL;
+        return;
+    }
+    const int nhue = 360;
+    const int ngrad = ceil((double)numregion / (double)nhue);
+    std::vector<Image::depth_t> couleurs(3 * (numregion + 1), 0);
+    for(int label = 1; label <= numregion; label++) {
+        const int n = label - 1; /* € [0, numregion[ */
+        const int hue = (int64_t)n * nhue / numregion; /* € [0, nhue[ ; en 64 bits, n * nhue dépasse 2^31 au-delà de 5,96 M régions */
+        const int grad = n - ceil((double)hue * (double)numregion / (double)nhue); /* € [0, ngrad[ */
+        QColor color = QColor::fromHsl(hue, 255, (grad + 1) * 255 / (ngrad + 1));
+        couleurs[3*label] = color.red();
+        couleurs[3*label+1] = color.green();
+        couleurs[3*label+2] = color.blue();
+    }
 
+    // chaque pixel de l'image de sortie prend la valeur de la valeur moyenne des pixels de la région à laquelle il appartient
+    GrayscaleImage* il = new GrayscaleImage(nbc, nbl);
     RgbImage* ic = new RgbImage(nbc, nbl);
-    for(int j=0 ; j<nbl ; j++) {
-        for(int i=0 ; i<nbc ; i++) {
-            int n = tablabel[j*nbc + i] - 1; /* € [0, numregion[ */
-            const int nhue = 360;
-            const int ngrad = ceil((double)numregion / (double)nhue);
-            const int hue = floor(n * nhue / numregion); /* € [0, nhue[ */
-            const int grad = n - ceil((double)hue * (double)numregion / (double)nhue); /* € [0, ngrad[ */
-            if(grad < 0 || grad >= ngrad) {
-                cout << "grad = " << grad << endl;
-            }
-            QColor color = QColor::fromHsl(hue, 255, (grad + 1) * 255 / (ngrad + 1));
-            ic->setPixel(i, j, 0, color.red());
-            ic->setPixel(i, j, 1, color.green());
-            ic->setPixel(i, j, 2, color.blue());
+    Image::depth_t *tabout = il->begin();
+    Image::depth_t *tabrgb = ic->begin();
+    const int *label = &tablabel[0];
+    const int *moyenne = &MoyCell[0];
+    const Image::depth_t *lut = &couleurs[0];
+    Parallel::forBands(0, size, [=](int debut, int fin) {
+        for(int p = debut; p < fin; p++) {
+            const int l = label[p];
+            tabout[p] = moyenne[l];
+            tabrgb[3*p] = lut[3*l];
+            tabrgb[3*p+1] = lut[3*l+1];
+            tabrgb[3*p+2] = lut[3*l+2];
         }
-    }
-
+    }, 1 << 16);
+    *luminance = il;
     *colorRgn = ic;
 
-
     tabin = NULL;
-    delete[] tabout;
-    delete[] tablabel;
-    delete[] MoyCell;
-    tabout = NULL;
-    tablabel = NULL;
-    MoyCell = NULL;
-
-    delete[] tab_min_ij;
-    tab_min_ij = NULL;
-
-    return numregion;
-}
-
-void Croissance::pushItem(int i, int j, int seuil, int numregion, float somlum, int nbpregion, int lum) {
-	croi_stackitem csi;
-	csi.i = i;
-	csi.j = j;
-	csi.seuil = seuil;
-	csi.numregion = numregion;
-	csi.somlum = somlum;
-	csi.nbpregion = nbpregion;
-	csi.lum = lum;
-    croi_stack.push_back( csi );
 }
 
+/* Remplit tabmin avec les indices (i*nbc+j) des pixels triés par luminance
+ * croissante, dans l'ordre du balayage pour une même luminance (tri par
+ * dénombrement). */
 void Croissance::find_min(int *tabmin) {
-	int i, j, z, cmpt ;
-    const Image::depth_t *val ;
-
-	z = 0 ;
-
-	for(cmpt=0 ; cmpt<256 ; cmpt++)
-	{
-		val = tabin ;
-		for(i=0 ; i<nbl ; i++)
-		{
-			for(j=0 ; j<nbc ; j++)
-			{
-				if( *val == cmpt)
-				{
-					*(tabmin+z)   = i ;
-					*(tabmin+z+1) = j ;
-					z += 2 ;
-				}
-				val++ ;
-			}
-		}
-	}
+    int debut[256] = {0};
+
+    // histogramme puis position du premier pixel de chaque niveau
+    for(int p = 0; p < size; p++)
+        debut[tabin[p]]++;
+    int z = 0;
+    for(int cmpt = 0; cmpt < 256; cmpt++) {
+        const int n = debut[cmpt];
+        debut[cmpt] = z;
+        z += n;
+    }
+
+    for(int p = 0; p < size; p++)
+        tabmin[debut[tabin[p]]++] = p;
 }
@@ -4,43 +4,53 @@
 #include <Image.h>
 #include <vector>
 
-class Croissance  
+class Croissance
 {
   public:
 
 	  // lment de la pile de candidats
 	struct croi_stackitem {
-        int i, j; // coordonnes du pixel candidat
-		int seuil; // seuil (donn par l'utilisateur au dbut de l'opration) -> pourquoi est il dans la structure et pas comme attribut de la classe croissance ?
-		int numregion; // numro de la region
-		float somlum; // luminance cumule des pixels contenus dans la rgion pour laquelle le pixel est candidat
-        int nbpregion; // nombre de pixels dans la rgion pour laquelle le pixel est candidat
-		int lum; // luminance du pixel candidat
+        int index; // indice du pixel candidat (i*nbc+j)
+        int chemin; // indice dans chemins de l'tat du pixel qui a empil le candidat
+	};
+	  // luminance cumule et nombre de pixels du chemin qui relie un pixel de la rgion au germe
+	struct croi_chemin {
+		float somlum;
+		int nbpregion;
 	};
 
 	Croissance();
 	virtual ~Croissance();
+    // numrotent les rgions de 1 au nombre de rgions, qu'elles renvoient ; luminance et colorRgn
+    // peuvent tre NULL quand seule la segmentation sert (avant fusionRegions)
     int croissance1a( const imagein::Image *im, int threshhold, imagein::Image **luminance, imagein::Image **colorRgn ); // At origin, | current - mean | < threshold
     int croissance1b( const imagein::Image *im, int threshhold, imagein::Image **luminance, imagein::Image **colorRgn ); //
     int croissance2a( const imagein::Image *im, int threshhold, imagein::Image **luminance, imagein::Image **colorRgn );
     int croissance2b( const imagein::Image *im, int threshhold, imagein::Image **luminance, imagein::Image **colorRgn );
+    // variante parallle : croissance indpendante par tuiles puis fusion des rgions de part et d'autre des bords de tuiles
+    int croissanceTuiles( const imagein::Image *im, int threshhold, bool germeMin, bool critereMoyenne, imagein::Image **luminance, imagein::Image **colorRgn );
+    // fusion hirarchique des rgions adjacentes issues du dernier appel a une des fonctions de croissance sur im
+    int fusionRegions( const imagein::Image *im, int numregion, int seuilFusion, int nbRegionsCible, imagein::Image **luminance, imagein::Image **colorRgn );
+
+    static const int TAILLE_TUILE = 256; // ct des tuiles de croissanceTuiles
 
 protected:
-	void parcours_parcelle1A();
-	void parcours_parcelle1B();
-	void parcours_parcelle2A();
-	void parcours_parcelle2B();
-    void pushItem(int i, int j, int seuil, int numregion, float somlum, int nbpregion, int lum);
-    void find_min(int *tabmin);
+    void init(const imagein::Image *im, int threshhold);
+    void init(const imagein::Image::depth_t *tab, long largeur, long hauteur, int threshhold);
+    int croissanceTuile(bool germeMin, bool critereMoyenne);
+	void parcours_parcelle1A(int germe, int numregion);
+	void parcours_parcelle1B(int germe, int numregion);
+    void pushVoisins(int index, int chemin);
+    void find_min(int *tabmin); // indices des pixels par luminance croissante
+    void sortie(int numregion, imagein::Image **luminance, imagein::Image **colorRgn);
 
     const imagein::Image::depth_t *tabin; // tableau de valeurs de l'image d'entre (luminance) [0 ; size[
-    imagein::Image::depth_t *tabout; // tableau de valeurs pour l'image de sortie (luminance) [0 ; size[
-    int *tablabel ; // tableau des numros de rgions pour chaque pixel de l'image [0 ; size[
+    std::vector<int> tablabel; // tableau des numros de rgions pour chaque pixel de l'image [0 ; size[
     long nbc,nbl,size ; // nombre de lignes, colonnes, et taille de l'image d'entre (et donc de sortie)
-    int *tab_min_ij;
-    float coefr,coefv,coefb;
-    std::vector<croi_stackitem> croi_stack; // pile contenant les pixels candidats a une rgion
-    int *MoyCell, NbPointCell; // tableau des valeurs moyenne des pixels par rgions [0 ; numregion[, nombre de pixels dans une rgion (?)
+    int seuil;
+    std::vector<croi_stackitem> croi_stack; // pile contenant les pixels candidats a une rgion, rutilise d'une rgion  l'autre
+    std::vector<croi_chemin> chemins; // tats des pixels ajouts a la rgion courante, rutilis d'une rgion  l'autre
+    std::vector<int> MoyCell; // tableau des valeurs moyenne des pixels par rgions [0 ; numregion]
 public:
 };
 
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef HISTOGRAMSCAN_H
+#define HISTOGRAMSCAN_H
+
+#include <Parallel.h>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Histogram, minimum and maximum of 8 bits samples in a single pass over a
+ * contiguous buffer.
+ *
+ * Four sub-histograms are filled in turn, so that runs of equal samples
+ * (frequent in images) do not serialize on the increment of the same
+ * counter ; they are added at the end. The minimum and the maximum are the
+ * first and last non empty bins, which costs 256 reads instead of a second
+ * pass. Large buffers are split in bands counted in parallel.
+ */
+namespace HistogramScan
+{
+    struct Result {
+        uint64_t count[256];
+        uint64_t total;
+        int min, max; // min > max when there is no sample
+    };
+
+    /* Counts the n samples data[0], data[stride], ..., data[(n-1)*stride] */
+    inline void countBand(const uint8_t* data, size_t n, size_t stride, uint64_t count[256]) {
+        uint32_t sub[4][256];
+        memset(sub, 0, sizeof(sub));
+        // les sous-histogrammes 32 bits sont vides tous les 2^30 echantillons
+        const size_t bloc = (size_t)1 << 30;
+        for(size_t debut = 0; debut < n; debut += bloc) {
+            const size_t fin = n - debut < bloc ? n : debut + bloc;
+            const uint8_t* p = data + debut * stride;
+            size_t i = debut;
+            if(stride == 1) {
+                for(; i + 4 <= fin; i += 4, p += 4) {
+                    sub[0][p[0]]++;
+                    sub[1][p[1]]++;
+                    sub[2][p[2]]++;
+                    sub[3][p[3]]++;
+                }
+            }
+            else {
+                for(; i + 4 <= fin; i += 4, p += 4 * stride) {
+                    sub[0][p[0]]++;
+                    sub[1][p[stride]]++;
+                    sub[2][p[2 * stride]]++;
+                    sub[3][p[3 * stride]]++;
+                }
+            }
+            for(; i < fin; ++i, p += stride) sub[0][*p]++;
+            for(int v = 0; v < 256; ++v) {
+                count[v] += (uint64_t)sub[0][v] + sub[1][v] + sub[2][v] + sub[3][v];
+            }
+            memset(sub, 0, sizeof(sub));
+        }
+    }
+
+    inline void scan(const uint8_t* data, size_t n, size_t stride, Result& r) {
+        memset(r.count, 0, sizeof(r.count));
+        const size_t grain = (size_t)1 << 20;
+        if(n < 2 * grain) {
+            countBand(data, n, stride, r.count);
+        }
+        else {
+            // un histogramme par bande, additionnes dans l'ordre des bandes
+            const int nbBands = (int)std::min<size_t>(Parallel::nbThreads(), n / grain);
+            std::vector<uint64_t> partial((size_t)nbBands * 256, 0);
+            Parallel::forEach(0, nbBands, [&](int b) {
+                const size_t debut = n * b / nbBands, fin = n * (b + 1) / nbBands;
+                countBand(data + debut * stride, fin - debut, stride, &partial[(size_t)b * 256]);
+            });
+            for(int b = 0; b < nbBands; ++b) {
+                for(int v = 0; v < 256; ++v) r.count[v] += partial[(size_t)b * 256 + v];
+            }
+        }
+        r.total = n;
+        r.min = 0;
+        while(r.min < 256 && r.count[r.min] == 0) ++r.min;
+        r.max = 255;
+        while(r.max >= 0 && r.count[r.max] == 0) --r.max;
+    }
+}
+
+#endif // HISTOGRAMSCAN_H
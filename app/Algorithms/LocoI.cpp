@@ -0,0 +1,437 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LocoI.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+    // parametres par defaut de JPEG-LS pour 8 bits
+    const int MAXVAL = 255, RANGE = 256, QBPP = 8, LIMIT = 32;
+    const int T1 = 3, T2 = 7, T3 = 21, RESET = 64;
+    const int MIN_C = -128, MAX_C = 127;
+    const int NB_CONTEXTES = 365; // 9 x 9 x 9 triplets de gradients quantifies, identifies a leur oppose
+    // longueurs des segments du mode plage
+    const int J[32] = {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+    inline int quantifierGradient(int d) {
+        if(d <= -T3) return -4;
+        if(d <= -T2) return -3;
+        if(d <= -T1) return -2;
+        if(d < 0) return -1;
+        if(d == 0) return 0;
+        if(d < T1) return 1;
+        if(d < T2) return 2;
+        if(d < T3) return 3;
+        return 4;
+    }
+
+    /**
+     * Gradients quantifies deja ponderes (81 q1, 9 q2, q3) pour d dans [-MAXVAL, MAXVAL] :
+     * la somme s des trois est nulle en mode plage, et comme |9 q2 + q3| < 81 son signe est celui
+     * du premier gradient non nul, donc |s| est le contexte et son signe celui de la symetrie.
+     */
+    class TableGradients
+    {
+      public:
+        TableGradients() {
+            for(int d = -MAXVAL; d <= MAXVAL; ++d) {
+                const int q = quantifierGradient(d);
+                _t[0][d + MAXVAL] = 81 * q;
+                _t[1][d + MAXVAL] = 9 * q;
+                _t[2][d + MAXVAL] = q;
+            }
+        }
+        int contexte(int a, int b, int c, int d) const {
+            return _t[0][d - b + MAXVAL] + _t[1][b - c + MAXVAL] + _t[2][c - a + MAXVAL];
+        }
+      private:
+        int16_t _t[3][2 * MAXVAL + 1];
+    };
+    const TableGradients gradients;
+
+    /* Median edge detector */
+    inline int predictionMED(int a, int b, int c) {
+        if(c >= max(a, b)) return min(a, b);
+        if(c <= min(a, b)) return max(a, b);
+        return a + b - c;
+    }
+
+    /* Erreur ramenee a [-RANGE / 2, RANGE / 2[ */
+    inline int reduire(int e) {
+        if(e < 0) e += RANGE;
+        if(e >= (RANGE + 1) / 2) e -= RANGE;
+        return e;
+    }
+
+    inline int ramener(int v) {
+        if(v < 0) return v + RANGE;
+        if(v > MAXVAL) return v - RANGE;
+        return v;
+    }
+
+    /* plus petit k tel que n 2^k >= a */
+    inline int parametreGolomb(int n, int a) {
+        return a <= n ? 0 : 32 - __builtin_clz((unsigned)(a - 1) / n);
+    }
+
+    /* Etat adaptatif, identique au codage et au decodage */
+    class Contextes
+    {
+      public:
+        Contextes() : indexPlage(0) {
+            const int a0 = max(2, (RANGE + 32) / 64);
+            fill(A, A + NB_CONTEXTES, a0);
+            fill(B, B + NB_CONTEXTES, 0);
+            fill(C, C + NB_CONTEXTES, 0);
+            fill(N, N + NB_CONTEXTES, 1);
+            fill(Ai, Ai + 2, a0);
+            fill(Ni, Ni + 2, 1);
+            fill(Nn, Nn + 2, 0);
+        }
+
+        /* prediction corrigee du biais du contexte q */
+        int prediction(int q, int signe, int px) const {
+            px += signe * C[q];
+            return px < 0 ? 0 : (px > MAXVAL ? MAXVAL : px);
+        }
+        int k(int q) const {
+            return parametreGolomb(N[q], A[q]);
+        }
+        int coderErreur(int q, int k, int e) const {
+            if(k == 0 && 2 * B[q] <= -N[q]) return e >= 0 ? 2 * e + 1 : -2 * (e + 1);
+            return e >= 0 ? 2 * e : -2 * e - 1;
+        }
+        int decoderErreur(int q, int k, int m) const {
+            if(k == 0 && 2 * B[q] <= -N[q]) return (m & 1) ? (m - 1) / 2 : -(m / 2) - 1;
+            return (m & 1) ? -(m + 1) / 2 : m / 2;
+        }
+        void miseAJour(int q, int e) {
+            B[q] += e;
+            A[q] += abs(e);
+            if(N[q] == RESET) {
+                A[q] >>= 1;
+                B[q] = B[q] >= 0 ? B[q] >> 1 : -((1 - B[q]) >> 1);
+                N[q] >>= 1;
+            }
+            N[q]++;
+            if(B[q] <= -N[q]) {
+                B[q] += N[q];
+                if(C[q] > MIN_C) C[q]--;
+                if(B[q] <= -N[q]) B[q] = -N[q] + 1;
+            }
+            else if(B[q] > 0) {
+                B[q] -= N[q];
+                if(C[q] < MAX_C) C[q]++;
+                if(B[q] > 0) B[q] = 0;
+            }
+        }
+
+        /* interruption de plage, ri = 1 si les voisins a et b sont egaux */
+        int kInterruption(int ri) const {
+            return parametreGolomb(Ni[ri], ri ? Ai[ri] + (Ni[ri] >> 1) : Ai[ri]);
+        }
+        bool positifsFavorises(int ri, int k) const {
+            return k == 0 && 2 * Nn[ri] < Ni[ri];
+        }
+        int coderInterruption(int ri, int k, int e) const {
+            const bool inverse = e > 0 ? positifsFavorises(ri, k) : (e < 0 && !positifsFavorises(ri, k));
+            return 2 * abs(e) - ri - (inverse ? 1 : 0);
+        }
+        int decoderInterruption(int ri, int k, int m) const {
+            const int t = m + ri;
+            const int inverse = t & 1;
+            const int e = (t + inverse) >> 1;
+            return ((inverse != 0) != positifsFavorises(ri, k)) ? -e : e;
+        }
+        void miseAJourInterruption(int ri, int e, int m) {
+            if(e < 0) Nn[ri]++;
+            Ai[ri] += (m + 1 - ri) >> 1;
+            if(Ni[ri] == RESET) {
+                Ai[ri] >>= 1;
+                Ni[ri] >>= 1;
+                Nn[ri] >>= 1;
+            }
+            Ni[ri]++;
+        }
+
+        void plageComplete() {
+            if(indexPlage < 31) indexPlage++;
+        }
+        void plageInterrompue() {
+            if(indexPlage > 0) indexPlage--;
+        }
+        int segment() const { return 1 << J[indexPlage]; }
+        int bitsReste() const { return J[indexPlage]; }
+        int limiteInterruption() const { return LIMIT - J[indexPlage] - 1; }
+
+      private:
+        int A[NB_CONTEXTES], B[NB_CONTEXTES], C[NB_CONTEXTES], N[NB_CONTEXTES];
+        int Ai[2], Ni[2], Nn[2];
+        int indexPlage;
+    };
+
+    /* Ecriture des bits, poids forts en premier */
+    class Ecrivain
+    {
+      public:
+        Ecrivain(vector<uint8_t>& sortie) : _sortie(sortie), _acc(0), _n(0) {}
+        /* nb <= 32 ; les bits sont vides par mots de 32 */
+        void ecrire(uint32_t v, int nb) {
+            _acc = (_acc << nb) | v;
+            _n += nb;
+            if(_n >= 32) {
+                _n -= 32;
+                const uint32_t mot = (uint32_t)(_acc >> _n);
+                const uint8_t octets[4] = {(uint8_t)(mot >> 24), (uint8_t)(mot >> 16), (uint8_t)(mot >> 8), (uint8_t)mot};
+                _sortie.insert(_sortie.end(), octets, octets + 4);
+            }
+        }
+        /* code de Golomb-Rice de parametre k, limite a limite bits */
+        void golomb(int m, int k, int limite) {
+            const int haut = m >> k;
+            if(haut < limite - QBPP - 1) {
+                ecrire(1, haut + 1);
+                if(k > 0) ecrire(m & ((1 << k) - 1), k);
+            }
+            else {
+                ecrire(1, limite - QBPP);
+                ecrire(m - 1, QBPP);
+            }
+        }
+        void terminer() {
+            for(; _n >= 8; _n -= 8) _sortie.push_back((uint8_t)(_acc >> (_n - 8)));
+            if(_n > 0) _sortie.push_back((uint8_t)(_acc << (8 - _n)));
+            _n = 0;
+        }
+      private:
+        vector<uint8_t>& _sortie;
+        uint64_t _acc;
+        int _n;
+    };
+
+    class Lecteur
+    {
+      public:
+        Lecteur(const vector<uint8_t>& entree) : _p(entree.empty() ? NULL : &entree[0]), _fin(_p + entree.size()), _tampon(0), _n(0) {}
+        uint32_t lire(int nb) {
+            if(nb == 0) return 0;
+            remplir();
+            const uint32_t v = (uint32_t)(_tampon >> (64 - nb));
+            _tampon <<= nb;
+            _n -= nb;
+            return v;
+        }
+        int golomb(int k, int limite) {
+            remplir();
+            // le bit de garde borne le compte sur un flux tronque
+            const int zeros = min(__builtin_clzll(_tampon | 1), limite - QBPP - 1);
+            _tampon <<= zeros + 1;
+            _n -= zeros + 1;
+            if(zeros < limite - QBPP - 1) return (zeros << k) | (int)lire(k);
+            return (int)lire(QBPP) + 1;
+        }
+      private:
+        void remplir() {
+            while(_n <= 56) {
+                _tampon |= (uint64_t)(_p < _fin ? *_p++ : 0) << (56 - _n);
+                _n += 8;
+            }
+        }
+        const uint8_t *_p, *_fin;
+        uint64_t _tampon;
+        int _n;
+    };
+}
+
+size_t LocoI::Flux::tailleOctets() const {
+    // largeur et hauteur
+    return octets.size() + 8;
+}
+
+void LocoI::encode(const uint8_t *pixels, int largeur, int hauteur, Flux& flux, int *erreurs) {
+    flux.largeur = largeur;
+    flux.hauteur = hauteur;
+    flux.octets.clear();
+    if(largeur <= 0 || hauteur <= 0) return;
+    flux.octets.reserve((size_t)largeur * hauteur / 2);
+
+    Ecrivain ecrivain(flux.octets);
+    Contextes ctx;
+    // lignes precedente et courante, bordees d'un pixel de chaque cote (la ligne avant la premiere est nulle)
+    vector<int> lignes(2 * (largeur + 2), 0);
+    int *prec = &lignes[0], *cour = &lignes[largeur + 2];
+    for(int y = 0; y < hauteur; ++y) {
+        const uint8_t *ligne = pixels + (size_t)y * largeur;
+        int *err = erreurs ? erreurs + (size_t)y * largeur - 1 : NULL; // indexe comme cour
+        for(int x = 0; x < largeur; ++x) cour[x + 1] = ligne[x];
+        cour[0] = prec[1];
+        prec[largeur + 1] = prec[largeur];
+
+        int x = 1;
+        while(x <= largeur) {
+            const int a = cour[x - 1], b = prec[x], c = prec[x - 1], d = prec[x + 1];
+            int q = gradients.contexte(a, b, c, d);
+            if(q == 0) {
+                // mode plage : longueur de la suite de pixels egaux a a
+                int fin = x;
+                while(fin <= largeur && cour[fin] == a) ++fin;
+                if(err) fill(err + x, err + fin, 0);
+                int reste = fin - x;
+                x = fin;
+                while(reste >= ctx.segment()) {
+                    ecrivain.ecrire(1, 1);
+                    reste -= ctx.segment();
+                    ctx.plageComplete();
+                }
+                if(x > largeur) {
+                    if(reste > 0) ecrivain.ecrire(1, 1);
+                    break;
+                }
+                ecrivain.ecrire(reste, ctx.bitsReste() + 1);
+
+                const int bx = prec[x];
+                const int ri = a == bx ? 1 : 0;
+                const int px = ri ? a : bx;
+                int e = cour[x] - px;
+                if(err) err[x] = e;
+                if(!ri && a > bx) e = -e;
+                e = reduire(e);
+                const int k = ctx.kInterruption(ri);
+                const int m = ctx.coderInterruption(ri, k, e);
+                ecrivain.golomb(m, k, ctx.limiteInterruption());
+                ctx.miseAJourInterruption(ri, e, m);
+                ctx.plageInterrompue();
+            }
+            else {
+                const int signe = q < 0 ? -1 : 1;
+                q *= signe;
+                const int px = ctx.prediction(q, signe, predictionMED(a, b, c));
+                int e = cour[x] - px;
+                if(err) err[x] = e;
+                e = reduire(signe * e);
+                const int k = ctx.k(q);
+                ecrivain.golomb(ctx.coderErreur(q, k, e), k, LIMIT);
+                ctx.miseAJour(q, e);
+            }
+            ++x;
+        }
+        swap(prec, cour);
+    }
+    ecrivain.terminer();
+}
+
+void LocoI::decode(const Flux& flux, uint8_t *pixels) {
+    const int largeur = flux.largeur, hauteur = flux.hauteur;
+    if(largeur <= 0 || hauteur <= 0) return;
+
+    Lecteur lecteur(flux.octets);
+    Contextes ctx;
+    vector<int> lignes(2 * (largeur + 2), 0);
+    int *prec = &lignes[0], *cour = &lignes[largeur + 2];
+    for(int y = 0; y < hauteur; ++y) {
+        cour[0] = prec[1];
+        prec[largeur + 1] = prec[largeur];
+
+        int x = 1;
+        while(x <= largeur) {
+            const int a = cour[x - 1], b = prec[x], c = prec[x - 1], d = prec[x + 1];
+            int q = gradients.contexte(a, b, c, d);
+            if(q == 0) {
+                bool finLigne = false;
+                while(lecteur.lire(1)) {
+                    const int n = min(ctx.segment(), largeur + 1 - x);
+                    fill(cour + x, cour + x + n, a);
+                    x += n;
+                    if(n == ctx.segment()) ctx.plageComplete();
+                    if(x > largeur) {
+                        finLigne = true;
+                        break;
+                    }
+                }
+                if(finLigne) break;
+                const int n = min((int)lecteur.lire(ctx.bitsReste()), largeur - x);
+                fill(cour + x, cour + x + n, a);
+                x += n;
+
+                const int bx = prec[x];
+                const int ri = a == bx ? 1 : 0;
+                const int px = ri ? a : bx;
+                const int k = ctx.kInterruption(ri);
+                const int m = lecteur.golomb(k, ctx.limiteInterruption());
+                const int e = ctx.decoderInterruption(ri, k, m);
+                ctx.miseAJourInterruption(ri, e, m);
+                ctx.plageInterrompue();
+                cour[x] = ramener(px + ((!ri && a > bx) ? -e : e));
+            }
+            else {
+                const int signe = q < 0 ? -1 : 1;
+                q *= signe;
+                const int px = ctx.prediction(q, signe, predictionMED(a, b, c));
+                const int k = ctx.k(q);
+                const int e = ctx.decoderErreur(q, k, lecteur.golomb(k, LIMIT));
+                ctx.miseAJour(q, e);
+                cour[x] = ramener(px + signe * e);
+            }
+            ++x;
+        }
+        uint8_t *ligne = pixels + (size_t)y * largeur;
+        for(int i = 0; i < largeur; ++i) ligne[i] = (uint8_t)cour[i + 1];
+        swap(prec, cour);
+    }
+}
+
+string LocoI::codage(const uint8_t *pixels, int largeur, int hauteur, int *erreurs, uint8_t *decodees) {
+    string returnval;
+    char buffer[255];
+    const size_t n = (size_t)max(largeur, 0) * max(hauteur, 0);
+    Flux flux;
+    vector<uint8_t> tampon;
+    if(decodees == NULL) {
+        tampon.resize(n);
+        decodees = tampon.empty() ? NULL : &tampon[0];
+    }
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    encode(pixels, largeur, hauteur, flux, erreurs);
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+    decode(flux, decodees);
+    chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+    const bool exacte = n == 0 || memcmp(decodees, pixels, n) == 0;
+
+    const double dureeCodage = max(chrono::duration<double>(t1 - t0).count(), 1e-9);
+    const double dureeDecodage = max(chrono::duration<double>(t2 - t1).count(), 1e-9);
+    returnval = returnval + "\n Codage sans pertes LOCO-I (JPEG-LS) : predicteur MED, correction du biais par contexte, codes de Golomb-Rice\n";
+    sprintf(buffer, " taille compressee = %lu octets (%lu octets non compresses)\n", (unsigned long)flux.tailleOctets(), (unsigned long)n);
+    returnval = returnval + buffer;
+    sprintf(buffer, " debit reel = %.4f bits/pixel, taux de compression = %.2f\n", n ? 8.0 * flux.tailleOctets() / n : 0.0,
+            flux.tailleOctets() ? (double)n / flux.tailleOctets() : 0.0);
+    returnval = returnval + buffer;
+    sprintf(buffer, " codage : %.1f Mpixels/s, decodage : %.1f Mpixels/s\n", n / dureeCodage * 1e-6, n / dureeDecodage * 1e-6);
+    returnval = returnval + buffer;
+    sprintf(buffer, " reconstruction exacte : %s\n", exacte ? "oui" : "NON");
+    returnval = returnval + buffer;
+    return returnval;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOCOI_H
+#define LOCOI_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Lossless coding of 8 bits images in the manner of LOCO-I / JPEG-LS
+ * (ISO 14495-1, NEAR = 0) : median edge detector prediction, 365 contexts
+ * from the quantized local gradients with bias correction, adaptive
+ * Golomb-Rice codes for the prediction errors and run mode on flat areas.
+ * The bitstream holds only the coded data : no markers nor byte stuffing.
+ */
+namespace LocoI
+{
+    struct Flux {
+        int largeur, hauteur;
+        std::vector<uint8_t> octets;
+        size_t tailleOctets() const; // donnees et en-tete
+    };
+
+    /* pixels : largeur x hauteur niveaux de gris ranges par lignes ; erreurs, si non nul, recoit
+     * l'erreur de prediction de chaque pixel (0 dans les plages) */
+    void encode(const uint8_t *pixels, int largeur, int hauteur, Flux& flux, int *erreurs = NULL);
+    void decode(const Flux& flux, uint8_t *pixels);
+    /* Codage effectif : debit reel, vitesses de codage et de decodage, verification de la reconstruction ;
+     * decodees, si non nul, recoit l'image decodee */
+    std::string codage(const uint8_t *pixels, int largeur, int hauteur, int *erreurs = NULL, uint8_t *decodees = NULL);
+}
+
+#endif // LOCOI_H
@@ -18,11 +18,13 @@
 */
 
 #include "Pyramid.h"
+#include <Parallel.h>
 #include <Algorithm/Filtering.h>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
 #include <cmath>
+#include <algorithm>
 using namespace std;
 using namespace imagein;
 using namespace Pyramid;
@@ -94,96 +96,156 @@ void Filters::getDefault( filtre &to_fill ) {
 
 /*---------------------------------------------------------------------------
     Cration de l'tage suivant de la pyramide Gaussienne
+    (dstTab doit contenir nextSize(srcWidth) x nextSize(srcHeight) points)
+    Seuls les points conserves par la decimation sont calcules : chaque ligne
+    de dstTab est filtree verticalement sur toute la largeur (boucle
+    contigue), puis horizontalement aux abscisses paires.
 ---------------------------------------------------------------------------*/
 void Pyramid::etage_suiv_g(const uint8_t *srcTab, uint8_t *dstTab, int srcWidth, int srcHeight, filtre &utile)
 {
-    cout << "etage_suiv_g " << srcWidth << " " << srcHeight << " " << endl;
-    cout << "src = " << (uintptr_t)srcTab << " dst = " << (uintptr_t)dstTab << endl;
-    int dstWidth = srcWidth / 2, dstHeight = srcHeight / 2;
-    uint8_t* intermed = new uint8_t[dstWidth * srcHeight];
-    for(int j = 0; j < srcHeight; ++j)
-    {
-        for(int i = 0; i < dstWidth; ++i)
-        {
-            intermed[i + j * dstWidth] = filt_point_1d_lg(srcTab, srcWidth, 2 * i, j, utile);
-//            intermed[i + j * dstWidth] = srcTab[2*i + j * srcWidth];
-        }
-    }
-    for(int i = 0; i < dstWidth; ++i)
-    {
-        for(int j = 0; j < dstHeight; ++j)
+    const int dstWidth = nextSize(srcWidth), dstHeight = nextSize(srcHeight);
+    const int t = utile.taille_f;
+    const float *c = utile.coeff_f;
+    /* points de dstTab dont le voisinage ne sort pas de l'image : [iBegin, iEnd[ */
+    const int iBegin = min(dstWidth, (t + 1) / 2);
+    const int iLast = srcWidth - 1 - t;
+    const int iEnd = iLast < 0 ? iBegin : max(iBegin, min(dstWidth, iLast / 2 + 1));
+
+    Parallel::forBands(0, dstHeight, [=](int jBegin, int jEnd) {
+        vector<float> col(srcWidth), lig(dstWidth);
+        vector<const uint8_t*> lignes(2 * t + 1);
+        for(int j = jBegin; j < jEnd; ++j)
         {
-            dstTab[i + j * dstWidth] = filt_point_1d_cl(intermed, srcHeight, dstWidth, i, j * 2, utile);
-//            dstTab[i + j * dstWidth] = intermed[i + 2 * j * dstWidth];
+            for(int k = -t; k <= t; ++k)
+            {
+                lignes[k + t] = srcTab + mirror(2 * j + k, srcHeight) * srcWidth;
+            }
+            /* filtrage vertical */
+            float *v = &col[0];
+            const uint8_t *centre = lignes[t];
+            for(int x = 0; x < srcWidth; ++x)
+            {
+                v[x] = c[0] * centre[x];
+            }
+            for(int k = 1; k <= t; ++k)
+            {
+                const uint8_t *haut = lignes[t - k], *bas = lignes[t + k];
+                const float ck = c[k];
+                for(int x = 0; x < srcWidth; ++x)
+                {
+                    v[x] += ck * (haut[x] + bas[x]);
+                }
+            }
+            /* filtrage horizontal aux abscisses paires : bords puis interieur */
+            float *h = &lig[0];
+            for(int i = 0; i < dstWidth; i = (i + 1 == iBegin) ? iEnd : i + 1)
+            {
+                float partiel = c[0] * v[2 * i];
+                for(int k = 1; k <= t; ++k)
+                {
+                    partiel += c[k] * (v[mirror(2 * i - k, srcWidth)] + v[mirror(2 * i + k, srcWidth)]);
+                }
+                h[i] = partiel;
+            }
+            for(int i = iBegin; i < iEnd; ++i)
+            {
+                h[i] = c[0] * v[2 * i];
+            }
+            for(int k = 1; k <= t; ++k)
+            {
+                const float ck = c[k];
+                for(int i = iBegin; i < iEnd; ++i)
+                {
+                    h[i] += ck * (v[2 * i - k] + v[2 * i + k]);
+                }
+            }
+            uint8_t *dst = dstTab + j * dstWidth;
+            for(int i = 0; i < dstWidth; ++i)
+            {
+                dst[i] = arrondi(h[i]);
+            }
         }
-    }
-    delete intermed;
+    }, max(1, (1 << 16) / max(1, srcWidth)));
 }
 
 /*---------------------------------------------------------------------------
     Cration d'une pyramide Gaussienne jusqu'au nime tage
+    rep[0] est une copie de l'image, rep[nStage] est l'etage le plus petit
 ---------------------------------------------------------------------------*/
-void Pyramid::pyram_g_n(uint8_t *rep, int nStage, long nbc, long nbl, const uint8_t *itab, filtre &utile)
+void Pyramid::pyram_g_n(Levels &rep, int nStage, int nbc, int nbl, const uint8_t *itab, filtre &utile)
 {
-    cout << "pyram_g_n " << nStage << " " << nbc << " " << nbl << endl;
-    int taille_c=nbc;
-    int taille_l=nbl;
-    const int size = nbc * nbl;
-    for(int i = 0; i < size; ++i)
+    rep.resize(nStage + 1);
+    rep[0] = Level<uint8_t>(nbc, nbl);
+    std::copy(itab, itab + nbc * nbl, rep[0].data.begin());
+    for(int k = 1; k <= nStage; ++k)
     {
-        rep[i] = itab[i];
-    }
-
-    int j = 0;
-    for(int fin = nStage; fin > 0 ; --fin)
-    {
-        etage_suiv_g((rep+j),(rep+j+taille_c*taille_l),taille_c,taille_l,utile);
-        j=j+taille_c*taille_l;
-        taille_l=taille_l/2;
-        taille_c=taille_c/2;
+        const Level<uint8_t> &src = rep[k - 1];
+        rep[k] = Level<uint8_t>(nextSize(src.width), nextSize(src.height));
+        etage_suiv_g(&src.data[0], &rep[k].data[0], src.width, src.height, utile);
     }
 }
 
 /*---------------------------------------------------------------------------
     Cration d'une pyramide Laplacienne jusqu'au nime tage
+    rep[k] = G(k) - agrandir(G(k+1)) est stocke sans perte sur 16 bits,
+    le dernier etage est celui de la pyramide Gaussienne.
+    Seuls deux etages Gaussiens sont conserves a la fois.
 ---------------------------------------------------------------------------*/
-void Pyramid::pyram_l_n (uint8_t *rep,int n, long nbc, long nbl, const uint8_t *itab, filtre &utile)
+void Pyramid::pyram_l_n(SignedLevels &rep, int n, int nbc, int nbl, const uint8_t *itab, filtre &utile)
 {
-    int i;
-    int j=0;
-    int fin=n;
-    int taille_c=nbc;
-    int taille_l=nbl;
-    uint8_t* pyra1 = new uint8_t[nbc*nbc*2];
-
-    pyram_g_n(pyra1,fin, nbc, nbl, itab, utile);
-    do
+    rep.resize(n + 1);
+    const uint8_t *src = itab;
+    int taille_c = nbc, taille_l = nbl;
+    Level<uint8_t> courant, suivant;
+    for(int k = 0; k < n; ++k)
     {
-        agrandir((pyra1+j+taille_c*taille_l),(rep+j),taille_c/2,taille_l/2,utile);
-
-        for(i=j;i<j+taille_c*taille_l;i++)
+        suivant = Level<uint8_t>(nextSize(taille_c), nextSize(taille_l));
+        etage_suiv_g(src, &suivant.data[0], taille_c, taille_l, utile);
+        Level<uint8_t> agrandi(taille_c, taille_l);
+        agrandir(suivant, agrandi, utile);
+        rep[k] = Level<int16_t>(taille_c, taille_l);
+        int16_t *diff = &rep[k].data[0];
+        const uint8_t *pred = &agrandi.data[0];
+        for(int i = 0; i < taille_c * taille_l; ++i)
         {
-            /* this overflow is important ! */
-            int n = 0;
-            n = n + pyra1[i];
-            n = n - rep[i];
-            if(n < -127) n = -127;
-            if(n > 128) n = 128;
-//            if(n > 255) n = 255;
-//            if(n < 0) n = 0;
-            rep[i] = n;
+            diff[i] = src[i] - pred[i];
         }
+        std::swap(courant, suivant);
+        src = &courant.data[0];
+        taille_c = courant.width;
+        taille_l = courant.height;
+    }
+    rep[n] = Level<int16_t>(taille_c, taille_l);
+    std::copy(src, src + taille_c * taille_l, rep[n].data.begin());
+}
 
-        j=j+taille_c*taille_l;
-        taille_c=taille_c/2;
-        taille_l=taille_l/2;
-        fin--;
-    }while(fin>0);
-    for(i=j;i<j+taille_c*taille_l;i++)
+/*---------------------------------------------------------------------------
+    Recomposition de l'image a partir de sa pyramide Laplacienne en
+    s'arretant a l'etage etage_rec : G(k) = rep[k] + agrandir(G(k+1))
+---------------------------------------------------------------------------*/
+GrayscaleImage *Pyramid::recomposition(const SignedLevels &pyra, int etage_rec, filtre &utile)
+{
+    const int etage_f = pyra.size() - 1;
+    const Level<int16_t> &sommet = pyra[etage_f];
+    Level<uint8_t> courant(sommet.width, sommet.height);
+    for(size_t i = 0; i < sommet.data.size(); ++i)
     {
-        *(rep+i)=*(pyra1+i);
+        const int value = sommet.data[i];
+        courant.data[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+    for(int k = etage_f; k > etage_rec; --k)
+    {
+        const Level<int16_t> &diff = pyra[k - 1];
+        Level<uint8_t> grand(diff.width, diff.height);
+        agrandir(courant, grand, utile);
+        for(size_t i = 0; i < grand.data.size(); ++i)
+        {
+            const int value = diff.data[i] + grand.data[i];
+            grand.data[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+        }
+        std::swap(courant, grand);
     }
-    delete[] pyra1;
+    return new GrayscaleImage(courant.width, courant.height, &courant.data[0]);
 }
 
 
@@ -193,372 +255,278 @@ void Pyramid::pyram_l_n (uint8_t *rep,int n, long nbc, long nbl, const uint8_t *
 ---------------------------------------------------------------------------*/
 Image *Pyramid::pyram_g(const GrayscaleImage *im, int etage_f, filtre &utile, string &to_print)
 {
-    if(!( im != NULL )) {
-        throw "Error in Pyramid::pyram_g:\nim = NULL";
-    }
-    if(!( im->getWidth() == im->getHeight() )) {
-        throw  "Error in Pyramid::pyram_g:\nim->getWidth() != im->getHeight()";
-    }
-    if( !isPowerOf2(im->getWidth()) ) {
-        throw  "Error in Pyramid::pyram_g:\nimage dimensions not a power of 2";
-    }
-    long nbl = im->getHeight();
-    long nbc = im->getWidth();
-    const uint8_t* itab = im->begin();
-
-//    uint8_t* rep = new uint8_t[nbc * nbl * 2];
-    GrayscaleImage* resImg = new GrayscaleImage(im->getWidth(), im->getHeight() * 2);
-    uint8_t* rep = resImg->begin();
-    cout << "rep = " << (uintptr_t)rep << endl;
-    int temp_etage_max = etage_max( im );
-    if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
-    if( etage_f < 1 ) etage_f = 1;
-
-    pyram_g_n(rep,etage_f,nbc,nbl,itab,utile);
-    to_print = entropie_p(rep,etage_f,nbc,nbl);
-    reconstruction(rep,etage_f,nbc,nbl);
-
-    return resImg;
+    Cache cache;
+    return cache.pyram_g(im, etage_f, utile, to_print);
 }
 /*---------------------------------------------------------------------------
     Cration d'un tage de la  pyramide Gaussienne
 ---------------------------------------------------------------------------*/
 Image *Pyramid::n_pyram_g(const Image *im, int etage_f, filtre &utile )
 {
-    if(!( im != NULL )) {
-        throw "Error in Pyramid::pyram_g:\nim = NULL";
-    }
-    if(!( im->getWidth() == im->getHeight() )) {
-        throw  "Error in Pyramid::pyram_g:\nim->getWidth() != im->getHeight()";
-    }
-    if( !isPowerOf2(im->getWidth()) ) {
-        throw  "Error in Pyramid::pyram_g:\nimage dimensions not a power of 2";
-    }
-
-    int i;
-    int k=0;
-    int taille_c,taille_l;
-    long nbl = im->getHeight();
-    long nbc = im->getWidth();
-    const uint8_t* itab = im->begin();
-
-    taille_c=nbc;
-    taille_l=nbl;
-    int temp_etage_max = etage_max(im);
-    if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
-    if( etage_f < 1 ) etage_f = 1;
-
-    for(i=0;i<etage_f;i++)
-    {
-        k=k+taille_c*taille_l;
-        taille_c=taille_c/2;
-        taille_l=taille_l/2;
-    }
-    GrayscaleImage* resImg = new GrayscaleImage(taille_c, taille_l);
-    uint8_t* rep = resImg->begin();
-    uint8_t* tab = new uint8_t[(nbc * nbc) / 2 * 3];
-    pyram_g_n(tab,etage_f,nbc,nbl,itab,utile);
-    for(i=0;i<taille_c*taille_l;i++)
-    {
-        rep[i] = tab[i+k];
-    }
-    delete[] tab;
-    return resImg;
+    Cache cache;
+    return cache.n_pyram_g(im, etage_f, utile);
 }
 /*---------------------------------------------------------------------------
     Cration d'une pyramide Laplacienne avec entre en conversationnel
     des diffrentes proprits de cette pyramide
 ---------------------------------------------------------------------------*/
-Image *Pyramid::pyram_l (const Image *im, int etage_f, filtre &utile, string &to_print)
+ImageDouble *Pyramid::pyram_l (const Image *im, int etage_f, filtre &utile, string &to_print)
 {
     if(!( im != NULL )) {
-        throw "Error in Pyramid::pyram_g:\nim = NULL";
+        throw "Error in Pyramid::pyram_l:\nim = NULL";
     }
-    if(!( im->getWidth() == im->getHeight() )) {
-        throw  "Error in Pyramid::pyram_g:\nim->getWidth() != im->getHeight()";
-    }
-    if( !isPowerOf2(im->getWidth()) ) {
-        throw  "Error in Pyramid::pyram_g:\nimage dimensions not a power of 2";
-    }
-    long nbl = im->getHeight();
-    long nbc = im->getWidth();
-    const uint8_t* itab = im->begin();
-
-//    uint8_t* rep = new uint8_t[nbc * nbl * 2];
-    GrayscaleImage* resImg = new GrayscaleImage(im->getWidth(), im->getHeight() * 2);
-    uint8_t* rep = resImg->begin();
     int temp_etage_max = etage_max( im );
     if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
     if( etage_f < 1 ) etage_f = 1;
 
-    pyram_l_n(rep,etage_f,nbc,nbl,itab,utile);
-    to_print = entropie_p(rep,etage_f,nbc,nbl);
-    reconstruction(rep,etage_f,nbc,nbl);
-
-    return resImg;
-
+    SignedLevels rep;
+    pyram_l_n(rep, etage_f, im->getWidth(), im->getHeight(), im->begin(), utile);
+    to_print = entropie_p(rep);
+    return reconstruction(rep, im->getWidth(), im->getHeight());
 }
 /*---------------------------------------------------------------------------
     Cration d'un tage de la  pyramide Laplacienne
 ---------------------------------------------------------------------------*/
-Image *Pyramid::n_pyram_l(const Image *im, int etage_f, filtre &utile)
+ImageDouble *Pyramid::n_pyram_l(const Image *im, int etage_f, filtre &utile)
 {
-    if(!( im != NULL )) {
-        throw "Error in Pyramid::pyram_g:\nim = NULL";
-    }
-    if(!( im->getWidth() == im->getHeight() )) {
-        throw  "Error in Pyramid::pyram_g:\nim->getWidth() != im->getHeight()";
-    }
-    if( !isPowerOf2(im->getWidth()) ) {
-        throw  "Error in Pyramid::pyram_g:\nimage dimensions not a power of 2";
-    }
-
-    int i;
-    int k=0;
-    int taille_c,taille_l;
-    long nbl = im->getHeight();
-    long nbc = im->getWidth();
-    const uint8_t* itab = im->begin();
-
-    taille_c=nbc;
-    taille_l=nbl;
-    int temp_etage_max = etage_max(im) - 1;
-    if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
-    if( etage_f < 0 ) etage_f = 0;
-
-    for(i=0;i<etage_f;i++)
-    {
-        k=k+taille_c*taille_l;
-        taille_c=taille_c/2;
-        taille_l=taille_l/2;
-    }
-    GrayscaleImage* resImg = new GrayscaleImage(taille_c, taille_l);
-    uint8_t* rep = resImg->begin();
-    uint8_t* tab = new uint8_t[(nbc * nbc) / 2 * 3];
-    pyram_g_n(tab,etage_f,nbc,nbl,itab,utile);
-    pyram_l_n(tab,etage_f+1,nbc,nbl,itab,utile);
-    for(i=0;i<taille_c*taille_l;i++)
-    {
-        rep[i] = tab[i+k];
-    }
-    delete[] tab;
-    return resImg;
+    Cache cache;
+    return cache.n_pyram_l(im, etage_f, utile);
 }
 
 
 
 /*---------------------------------------------------------------------------
-    Filtrage d'un point de l'image suivant une ligne
+    Agrandissement d'une image (avec filtrage)
+    grand doit etre dimensionne : sa largeur vaut 2*petit.width ou
+    2*petit.width-1 (idem pour la hauteur)
+    Le calcul est fait en entier (coefficients sur 12 bits, gain de 2 par
+    dimension inclus) : le resultat ne depend ni de la machine ni du
+    decoupage en threads, ce qui rend la pyramide Laplacienne exactement
+    reversible.
 ---------------------------------------------------------------------------*/
-uint8_t Pyramid::filt_point_1d_lg(const uint8_t *tab,int cl, int x, int y, filtre &utile)
+void Pyramid::agrandir(const Level<uint8_t> &petit, Level<uint8_t> &grand, filtre &utile)
 {
-    float partiel=0.;
-    int i;
-    int j;
-    j=utile.taille_f;
-    if(x-j<0)
-    {
-        for(i=-j;i<=j;i++)
-        {
-            if(x+i<0)
-                partiel += *(tab+y*cl+x-i)*utile.coeff_f[-i];
-            else if(i<0)
-                partiel += *(tab+y*cl+x+i)*utile.coeff_f[-i];
-            else
-                partiel += *(tab+y*cl+x+i)*utile.coeff_f[i];
-        }
-    }else if(x+j<cl)
+    const int t = utile.taille_f;
+    const int W = grand.width, H = grand.height;
+    int q[10];
+    for(int k = 0; k <= t; ++k)
     {
-        for(i=-j;i<=j;i++)
+        q[k] = (int)floor(utile.coeff_f[k] * 8192.f + 0.5f);
+    }
+    /* sur-echantillonnage et filtrage des lignes : seuls les points pairs
+       de la ligne sur-echantillonnee sont non nuls, les sorties paires et
+       impaires utilisent donc chacune la moitie des coefficients */
+    const int mBegin = min(petit.width, (t + 1) / 2);
+    const int mLast = W - 2 - t;
+    const int mEnd = mLast < 0 ? mBegin : max(mBegin, min(petit.width, mLast / 2 + 1));
+    vector<int16_t> intermed(W * petit.height);
+    Parallel::forBands(0, petit.height, [&](int jBegin, int jEnd) {
+        vector<int> pair_l(petit.width), impair_l(petit.width);
+        int *pair = &pair_l[0], *impair = &impair_l[0];
+        for(int j = jBegin; j < jEnd; ++j)
         {
-            if(i<0)
-                partiel += *(tab+y*cl+x+i)*utile.coeff_f[-i];
-            else
-                partiel += *(tab+y*cl+x+i)*utile.coeff_f[i];
+            const uint8_t *ligne = petit.row(j);
+            int16_t *dst = &intermed[j * W];
+            if(W == 1)
+            {
+                /* une seule colonne : pas de sur-echantillonnage */
+                dst[0] = ligne[0];
+                continue;
+            }
+            /* bords */
+            for(int i = 0; i < W; i = (i + 1 == 2 * mBegin) ? 2 * mEnd : i + 1)
+            {
+                int partiel = 0;
+                for(int k = -t; k <= t; ++k)
+                {
+                    const int x = mirror(i + k, W);
+                    if((x & 1) == 0) partiel += q[k < 0 ? -k : k] * ligne[x >> 1];
+                }
+                dst[i] = (partiel + 2048) >> 12;
+            }
+            /* interieur : dst[2m] et dst[2m+1] */
+            std::fill(pair, pair + petit.width, 0);
+            std::fill(impair, impair + petit.width, 0);
+            for(int k = -t; k <= t; ++k)
+            {
+                const int qk = q[k < 0 ? -k : k];
+                int *somme = (k & 1) ? impair : pair;
+                const uint8_t *src = ligne + ((k & 1) ? (k + 1) / 2 : k / 2);
+                for(int m = mBegin; m < mEnd; ++m)
+                {
+                    somme[m] += qk * src[m];
+                }
+            }
+            for(int m = mBegin; m < mEnd; ++m)
+            {
+                dst[2 * m] = (pair[m] + 2048) >> 12;
+                dst[2 * m + 1] = (impair[m] + 2048) >> 12;
+            }
         }
-    }
-    else
-    {
-        for(i=-j;i<=j;i++)
+    }, max(1, (1 << 16) / max(1, W)));
+    /* sur-echantillonnage et filtrage des colonnes, ligne par ligne */
+    Parallel::forBands(0, H, [&](int jBegin, int jEnd) {
+        vector<int> somme_l(W);
+        int *somme = &somme_l[0];
+        for(int j = jBegin; j < jEnd; ++j)
         {
-            if(i<0)
-                partiel += *(tab+y*cl+x+i)*utile.coeff_f[-i];
-            else if(i+x<cl)
-                partiel += *(tab+y*cl+x+i)*utile.coeff_f[i];
-            else
-                partiel += *(tab+y*cl+x-i)*utile.coeff_f[i];
+            if(H == 1)
+            {
+                /* une seule ligne : pas de sur-echantillonnage */
+                uint8_t *ligne = grand.row(j);
+                for(int i = 0; i < W; ++i)
+                {
+                    ligne[i] = intermed[i] < 0 ? 0 : (intermed[i] > 255 ? 255 : intermed[i]);
+                }
+                continue;
+            }
+            std::fill(somme, somme + W, 0);
+            for(int k = -t; k <= t; ++k)
+            {
+                const int y = mirror(j + k, H);
+                if(y & 1) continue;
+                const int16_t *src = &intermed[(y >> 1) * W];
+                const int qk = q[k < 0 ? -k : k];
+                for(int i = 0; i < W; ++i)
+                {
+                    somme[i] += qk * src[i];
+                }
+            }
+            uint8_t *ligne = grand.row(j);
+            for(int i = 0; i < W; ++i)
+            {
+                const int value = (somme[i] + 2048) >> 12;
+                ligne[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+            }
         }
-    }
-    return((uint8_t)partiel);
+    }, max(1, (1 << 16) / max(1, W)));
 }
 
 /*---------------------------------------------------------------------------
-    Filtrage d'un point de l'image suivant une colonne
+    Hauteur de l'image contenant une pyramide de etage_f etages :
+    l'image d'origine en haut, les etages suivants empiles en dessous
+    (au moins nbl lignes, pour garder le format 2*nbl des images carrees)
 ---------------------------------------------------------------------------*/
-uint8_t Pyramid::filt_point_1d_cl(const uint8_t *tab,int lg,int cl, int x, int y, filtre &utile)
+int Pyramid::hauteur_pyramide(int nbl, int etage_f)
 {
-    float partiel=0.;
-    int i;
-    int j=utile.taille_f;
-    if(y-j<0)
+    int taille_l = nbl;
+    int somme = 0;
+    for(int i = 0; i < etage_f; ++i)
     {
-        for(i=-j;i<=j;i++)
-        {
-            if(y+i<0)
-                partiel += *(tab+x+(y-i)*cl)*utile.coeff_f[-i];
-            else if(i<0)
-                partiel += *(tab+x+(y+i)*cl)*utile.coeff_f[-i];
-            else
-                partiel += *(tab+x+(y+i)*cl)*utile.coeff_f[i];
-        }
-    }else if(y+j<lg)
-    {
-        for(i=-j;i<=j;i++)
-        {
-            if(i<0)
-                partiel += *(tab+x+(y+i)*cl)*utile.coeff_f[-i];
-            else
-                partiel += *(tab+x+(y+i)*cl)*utile.coeff_f[i];
-        }
+        taille_l = nextSize(taille_l);
+        somme += taille_l;
     }
-    else
-    {
-        for(i=-j;i<=j;i++)
-        {
-            if(i<0)
-                partiel += *(tab+x+(y+i)*cl)*utile.coeff_f[-i];
-            else if(i+y<cl)
-                partiel += *(tab+x+(y+i)*cl)*utile.coeff_f[i];
-            else
-                partiel += *(tab+x+(y-i)*cl)*utile.coeff_f[i];
-        }
-    }
-    return((uint8_t)partiel);
-}
-/*---------------------------------------------------------------------------
-    Filtrage d'une ligne
----------------------------------------------------------------------------*/
-void Pyramid::filt_ligne(uint8_t *ligne,int taille_c, filtre &utile)
-{
-    int i;
-    uint8_t *intermed;
-    intermed=(uint8_t*)calloc(taille_c,sizeof(uint8_t));
-    for(i=0;i<taille_c;i++)
-    {
-        *(intermed+i)=filt_point_1d_lg(ligne,taille_c,i,0,utile);
-    }
-    for(i=0;i<taille_c;i++)
-    {
-        *(ligne+i)=*(intermed+i);
-    }
-    free(intermed);
+    return nbl + max(nbl, somme);
 }
+
 /*---------------------------------------------------------------------------
-    Filtrage d'une image suivant les colonnes
+    Rarangement de la pyramide dans une image
 ---------------------------------------------------------------------------*/
-void Pyramid::filt_tab_cl(uint8_t *tab,int taille_c,int taille_l, filtre &utile)
+template<typename T, typename D>
+static void ranger(const vector<Level<T> > &pyra, D *rep, int nbc)
 {
-    int i,j;
-    uint8_t *intermed;
-    intermed=(uint8_t*)calloc(taille_c*taille_l,sizeof(uint8_t));
-    for(j=0;j<taille_l;j++)
-    {
-        for(i=0;i<taille_c;i++)
-        {
-            *(intermed+i+j*taille_c)=filt_point_1d_cl(tab,taille_l,taille_c,i,j,utile);
-        }
-    }
-    for(j=0;j<taille_l;j++)
+    int p = 0;
+    for(size_t n = 0; n < pyra.size(); ++n)
     {
-        for(i=0;i<taille_c;i++)
+        const Level<T> &etage = pyra[n];
+        for(int j = 0; j < etage.height; ++j)
         {
-            *(tab+i+j*taille_c)= *(intermed+i+j*taille_c) * 4;
+            std::copy(etage.row(j), etage.row(j) + etage.width, rep + (p + j) * nbc);
         }
+        p += etage.height;
     }
-    free(intermed);
+}
+
+GrayscaleImage *Pyramid::reconstruction(const Levels &pyra, int nbc, int nbl)
+{
+    GrayscaleImage *resImg = new GrayscaleImage(nbc, hauteur_pyramide(nbl, pyra.size() - 1));
+    std::fill(resImg->begin(), resImg->end(), 0);
+    ranger(pyra, resImg->begin(), nbc);
+    return resImg;
+}
+
+ImageDouble *Pyramid::reconstruction(const SignedLevels &pyra, int nbc, int nbl)
+{
+    ImageDouble *resImg = new ImageDouble(nbc, hauteur_pyramide(nbl, pyra.size() - 1), 1, 0.);
+    ranger(pyra, resImg->begin(), nbc);
+    return resImg;
 }
 
 /*---------------------------------------------------------------------------
-    Agrandissement d'une image (avec filtrage)
+    Extraction des etages d'une pyramide rangee par reconstruction
 ---------------------------------------------------------------------------*/
-void Pyramid::agrandir(uint8_t *petit,uint8_t *grand,int taille_c,int taille_l, filtre &utile)
+static inline int16_t entier(uint8_t v) { return v; }
+static inline int16_t entier(double v) { return (int16_t)floor(v + 0.5); }
+
+template<typename D>
+static void extraire(const D *tab, int nbc, int hauteur, int etage_f, SignedLevels &pyra)
 {
-    int i,j;
-    uint8_t *intermed;
-    intermed=(uint8_t*)calloc(taille_c*taille_l*2,sizeof(uint8_t));
-    for(j=0;j<taille_l;j++)
+    int nbl = 0;
+    for(int h = 1; h <= hauteur / 2 && nbl == 0; ++h)
     {
-        for(i=0;i<taille_c;i++)
-        {
-            *(intermed+i*2+j*taille_c*2)=*(petit+i+j*taille_c);
-            *(intermed+i*2+j*taille_c*2+1)=0;
-        }
+        if(hauteur_pyramide(h, etage_f) == hauteur) nbl = h;
     }
-    for(j=0;j<taille_l;j++)
-    {
-        filt_ligne((intermed+j*taille_c*2),taille_c*2,utile);
+    if(nbl == 0) {
+        throw "Error in Pyramid::extraction:\nthe image height does not match a pyramid of this number of steps";
     }
-    for(j=0;j<taille_l;j++)
+    pyra.resize(etage_f + 1);
+    int taille_c = nbc, taille_l = nbl;
+    int p = 0;
+    for(int n = 0; n <= etage_f; ++n)
     {
-        for(i=0;i<taille_c*2;i++)
+        pyra[n] = Level<int16_t>(taille_c, taille_l);
+        for(int j = 0; j < taille_l; ++j)
         {
-            *(grand+i+(j*2)*taille_c*2)=*(intermed+i+j*taille_c*2);
-            *(grand+i+(j*2+1)*taille_c*2)=0;
+            const D *src = tab + (p + j) * nbc;
+            int16_t *dst = pyra[n].row(j);
+            for(int i = 0; i < taille_c; ++i)
+            {
+                dst[i] = entier(src[i]);
+            }
         }
+        p += taille_l;
+        taille_c = nextSize(taille_c);
+        taille_l = nextSize(taille_l);
     }
-    filt_tab_cl(grand,taille_c*2,taille_l*2,utile);
-    free(intermed);
 }
 
-/*---------------------------------------------------------------------------
-    Rarangement de la pyramide
----------------------------------------------------------------------------*/
-
-void Pyramid::reconstruction(uint8_t *pyra,int n, long nbc, long nbl)
-{
-    int i,j,k;
-    int q=0;
-    int p=0;
-    int fin=n;
-    int taille_c=nbc;
-    int taille_l=nbl;
-    uint8_t *intermed;
-    intermed=(uint8_t*)calloc(nbc*nbl,sizeof(uint8_t));
-    do
+/* Ancien format sur 8 bits : les differences negatives sont codees au-dela de 128 */
+void Pyramid::extraction(const Image *pyramid, int etage_f, SignedLevels &pyra)
+{
+    extraire(pyramid->begin(), pyramid->getWidth(), pyramid->getHeight(), etage_f, pyra);
+    for(int n = 0; n < etage_f; ++n)
     {
-        q=q+taille_c*taille_l;
-        taille_c=taille_c/2;
-        taille_l=taille_l/2;
-        k=0;
-        for(j=p;j<p+taille_l;j++)
+        for(size_t i = 0; i < pyra[n].data.size(); ++i)
         {
-            for(i=0;i<taille_c;i++)
-            {
-                *(intermed+j*nbc+i)=*(pyra+k+q);
-                k++;
-            }
+            if(pyra[n].data[i] > 128) pyra[n].data[i] -= 256;
         }
-        p=p+taille_l;
-        fin--;
-    }while(fin>0);
-    for(i=0;i<nbc*nbl;i++)
-    {
-        *(pyra+nbc*nbl+i)=*(intermed+i);
     }
-   free(intermed);
+}
+
+void Pyramid::extraction(const ImageDouble *pyramid, int etage_f, SignedLevels &pyra)
+{
+    if(pyramid->getNbChannels() != 1) {
+        throw "Error in Pyramid::extraction:\nthe pyramid must have only one channel";
+    }
+    extraire(pyramid->begin(), pyramid->getWidth(), pyramid->getHeight(), etage_f, pyra);
 }
 
 int Pyramid::etage_max(const Image *im)
+{
+    return etage_max(im->getWidth(), im->getHeight());
+}
+
+/*---------------------------------------------------------------------------
+    Nombre d'etages necessaires pour arriver a un seul point
+---------------------------------------------------------------------------*/
+int Pyramid::etage_max(int nbc, int nbl)
 {
     int i;
-    int taille_c=im->getWidth();
-    int taille_l=im->getHeight();
-    for(i=0;taille_c||taille_l>1;i++)
+    for(i = 0; nbc > 1 || nbl > 1; i++)
     {
-        taille_c=taille_c/2;
-        taille_l=taille_l/2;
+        nbc = nextSize(nbc);
+        nbl = nextSize(nbl);
     }
-    i--;
     return(i);
 }
 
@@ -602,112 +570,315 @@ float Pyramid::entropie2(const uint8_t *tab,int taille_c,int taille_l)
 /*----------------------------------------------------------------------
  Calcul et affichage de l'entropie des diffrents tages d'une pyramide
 ----------------------------------------------------------------------*/
-string Pyramid::entropie_p(const uint8_t *pyra,int etage_f,int nbc,int nbl)
+string Pyramid::entropie_p(const Levels &pyra)
 {
-    int i;
-    int j=0;
     float h;
-    int taille_c=nbc;
-    int taille_l=nbl;
     char buffer[255];
     string returnval;
-    for(i=0;i<=etage_f;i++)
+    for(size_t i = 0; i < pyra.size(); i++)
     {
-        h=entropie2((pyra+j),taille_c,taille_l);
-        j=j+taille_c*taille_l;
-        taille_c=taille_c/2;
-        taille_l=taille_l/2;
-        sprintf(buffer, "L'entropie de l'tage %d est %1f\n",i,h);
+        h=entropie2(&pyra[i].data[0],pyra[i].width,pyra[i].height);
+        sprintf(buffer, "L'entropie de l'tage %d est %1f\n",(int)i,h);
         returnval = returnval + buffer;
     }
    return returnval;
 }
 
+string Pyramid::entropie_p(const SignedLevels &pyra)
+{
+    char buffer[255];
+    string returnval;
+    vector<int> pi(1 << 16);
+    for(size_t i = 0; i < pyra.size(); i++)
+    {
+        const vector<int16_t> &tab = pyra[i].data;
+        std::fill(pi.begin(), pi.end(), 0);
+        for(size_t j = 0; j < tab.size(); j++)
+        {
+            pi[(uint16_t)tab[j]]++;
+        }
+        double h = 0;
+        for(size_t j = 0; j < pi.size(); j++)
+        {
+            if(pi[j] != 0)
+            {
+                const double p = (double)pi[j] / tab.size();
+                h -= p * log(p) / log(2.0);
+            }
+        }
+        sprintf(buffer, "L'entropie de l'tage %d est %1f\n",(int)i,h);
+        returnval = returnval + buffer;
+    }
+   return returnval;
+}
+
+
+static Image *rebuild(const SignedLevels &rep, int etage_f, int pyramid_to, filtre &utile)
+{
+    if( etage_f > max(1, etage_max(rep[0].width, rep[0].height)) ) {
+        throw "Error in Pyramid::rebuild_interface:\nInvalid etage_f specified";
+    }
+    return recomposition(rep, pyramid_to, utile);
+}
 
 Image *Pyramid::rebuild_interface( const Image *pyramid, int etage_f, int pyramid_to, filtre &utile ) {
-    // rebuilds from an image that was saved
+    // rebuilds from an 8 bits image that was saved
     // etage_f = stage that the original image was built to
-    char buffer[255];
     if(!pyramid) {
-        throw "Error in TP6Pyramid::rebuild_interface:\npyramid = NULL";
+        throw "Error in Pyramid::rebuild_interface:\npyramid = NULL";
     }
-    if(pyramid->getWidth() * 2 != pyramid->getHeight()) {
-        sprintf( buffer, "Error in TP6Pyramid::rebuild_interface:\npyramid->getWidth = %d, pyramid->getHeight = %d", pyramid->getWidth(), pyramid->getHeight() );
-        throw buffer;
+    if( etage_f <= 0 ) {
+        throw "Error in Pyramid::rebuild_interface:\nInvalid etage_f specified";
+    }
+    if(pyramid_to < 0 || pyramid_to >= etage_f) {
+        throw "Error in Pyramid::rebuild_interface:\nInvalid pyramid_to specified";
     }
-    if(!(isPowerOf2(pyramid->getWidth()))) {
-        throw "Error in TP6Pyramid::rebuild_interface:\npyramid->getWidth not a power of 2";
+    SignedLevels rep;
+    extraction(pyramid, etage_f, rep);
+    return rebuild(rep, etage_f, pyramid_to, utile);
+}
+
+Image *Pyramid::rebuild_interface( const ImageDouble *pyramid, int etage_f, int pyramid_to, filtre &utile ) {
+    // rebuilds exactly from the output of pyram_l
+    if(!pyramid) {
+        throw "Error in Pyramid::rebuild_interface:\npyramid = NULL";
     }
-    if( etage_f <= 0 || (1 << etage_f) > pyramid->getWidth() ) {
-        throw "Error in TP6Pyramid::rebuild_interface:\nInvalid etage_f specified";
+    if( etage_f <= 0 ) {
+        throw "Error in Pyramid::rebuild_interface:\nInvalid etage_f specified";
     }
     if(pyramid_to < 0 || pyramid_to >= etage_f) {
-        throw "Error in TP6Pyramid::rebuild_interface:\nInvalid pyramid_to specified";
+        throw "Error in Pyramid::rebuild_interface:\nInvalid pyramid_to specified";
     }
-    long nbc = pyramid->getWidth();
-    long nbl = pyramid->getWidth();
-    int i;
-    int j=0;
-    int taille_c=nbc;
-    int taille_l=nbl;
-    Image *returnval = NULL;
-    int taille;
-    int q=0;
-    int etage_rec;
-    const uint8_t *pyra1 = pyramid->begin();
-    uint8_t* intermed = new uint8_t[nbc * nbc / 2 * 3];
-    uint8_t* rep = new uint8_t[nbc * nbc / 2 * 3];
-
-    // Copy info into rep in a packed format
-    long current_offset = 0;
-    long current_rep_offset = 0;
-    for(int n = 0; n <= etage_f; ++n) {
-        for(int j=0; j< taille_l; j++ ) {
-            for(int i=0; i< taille_c; i++ ) {
-                rep[current_rep_offset + j * taille_c + i] = pyra1[current_offset + j * pyramid->getWidth() + i];
+    SignedLevels rep;
+    extraction(pyramid, etage_f, rep);
+    return rebuild(rep, etage_f, pyramid_to, utile);
+}
+
+/*---------------------------------------------------------------------------
+    Melange multi-resolution de deux images : chaque etage Laplacien du
+    resultat est la moyenne des etages de a et de b ponderee par l'etage
+    de la pyramide Gaussienne du masque (255 : a, 0 : b), puis l'image est
+    recomposee. Les images sont ramenees a leur taille commune.
+---------------------------------------------------------------------------*/
+Image *Pyramid::blend(const Image *a, const Image *b, const Image *mask, int etage_f, filtre &utile)
+{
+    if(a == NULL || b == NULL || mask == NULL) {
+        throw "Error in Pyramid::blend:\nimage = NULL";
+    }
+    const int nbc = min(min(a->getWidth(), b->getWidth()), mask->getWidth());
+    const int nbl = min(min(a->getHeight(), b->getHeight()), mask->getHeight());
+    const int nbChannels = min(a->getNbChannels(), b->getNbChannels());
+    int temp_etage_max = etage_max(nbc, nbl);
+    if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
+    if( etage_f < 1 ) etage_f = 1;
+
+    /* pyramides des canaux de a, des canaux de b et du masque, construites en parallele */
+    vector<SignedLevels> lap(2 * nbChannels);
+    Levels gaussMask;
+    Parallel::forEach(0, 2 * nbChannels + 1, [&](int p) {
+        const Image *im = (p < nbChannels) ? a : (p < 2 * nbChannels ? b : mask);
+        const int c = (p < 2 * nbChannels) ? p % nbChannels : 0;
+        const int stride = im->getNbChannels();
+        const uint8_t *tab = im->begin();
+        vector<uint8_t> plan(nbc * nbl);
+        for(int j = 0; j < nbl; ++j)
+        {
+            for(int i = 0; i < nbc; ++i)
+            {
+                plan[j * nbc + i] = tab[(j * im->getWidth() + i) * stride + c];
             }
         }
-        current_offset = current_offset + taille_l * nbc;
-        current_rep_offset = current_rep_offset + taille_l * taille_c;
-        taille_l = taille_l / 2;
-        taille_c = taille_c / 2;
-    }
+        if(p < 2 * nbChannels) {
+            pyram_l_n(lap[p], etage_f, nbc, nbl, &plan[0], utile);
+        }
+        else {
+            pyram_g_n(gaussMask, etage_f, nbc, nbl, &plan[0], utile);
+        }
+    });
+
+    Image *resImg = new Image(nbc, nbl, nbChannels);
+    Parallel::forEach(0, nbChannels, [&](int c) {
+        SignedLevels &la = lap[c];
+        const SignedLevels &lb = lap[nbChannels + c];
+        for(int k = 0; k <= etage_f; ++k)
+        {
+            const vector<uint8_t> &m = gaussMask[k].data;
+            int16_t *da = &la[k].data[0];
+            const int16_t *db = &lb[k].data[0];
+            for(size_t i = 0; i < m.size(); ++i)
+            {
+                const int v = m[i] * da[i] + (255 - m[i]) * db[i];
+                da[i] = v >= 0 ? (v + 127) / 255 : -((127 - v) / 255);
+            }
+        }
+        GrayscaleImage *plan = recomposition(la, 0, utile);
+        const uint8_t *src = plan->begin();
+        uint8_t *dst = resImg->begin();
+        for(int i = 0; i < nbc * nbl; ++i)
+        {
+            dst[i * nbChannels + c] = src[i];
+        }
+        delete plan;
+    });
+    return resImg;
+}
 
-/* reconstruction de l'image  partir de sa pyramide laplacienne en s'arretant
-     un niveau etage_rec choisi par l'utilisateur
-    La pyramide est contenue dans la zone mmoire pointe par rep */
-    etage_rec = pyramid_to;
-    taille=nbc;
+/*---------------------------------------------------------------------------
+    Pyramides d'une image calculees a la demande
+---------------------------------------------------------------------------*/
+Pyramid::Cache::Cache() : _width(0), _height(0), _checksum(0)
+{
+    memset(&_filtre, 0, sizeof(_filtre));
+}
+
+void Pyramid::Cache::clear()
+{
+    _gauss.clear();
+    _lap.clear();
+    _width = _height = 0;
+    _checksum = 0;
+}
+
+/* Somme de controle de l'image, calculee par mots de 64 bits */
+static uint64_t checksum(const uint8_t *tab, size_t size)
+{
+    uint64_t h = 14695981039346656037ULL;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8)
+    {
+        uint64_t mot;
+        memcpy(&mot, tab + i, 8);
+        h = (h ^ mot) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    for(; i < size; ++i)
+    {
+        h = (h ^ tab[i]) * 1099511628211ULL;
+    }
+    return h;
+}
 
-    for(i=0;i<etage_f;i++)
+void Pyramid::Cache::check(const Image *im, const filtre &utile)
+{
+    if(im == NULL) {
+        throw "Error in Pyramid::Cache:\nim = NULL";
+    }
+    const size_t size = (size_t)im->getWidth() * im->getHeight();
+    const uint64_t sum = checksum(im->begin(), size);
+    bool valide = !_gauss.empty() && im->getWidth() == _width && im->getHeight() == _height
+                  && sum == _checksum && utile.taille_f == _filtre.taille_f;
+    for(int k = 0; valide && k <= utile.taille_f; ++k)
     {
-        q=q+taille*taille;
-        taille=taille/2;
+        valide = (utile.coeff_f[k] == _filtre.coeff_f[k]);
     }
-    for(i=q;i<q+taille*taille;i++)
+    if(valide) return;
+
+    clear();
+    _width = im->getWidth();
+    _height = im->getHeight();
+    _checksum = sum;
+    _filtre = utile;
+    _gauss.push_back(Level<uint8_t>(_width, _height));
+    std::copy(im->begin(), im->begin() + size, _gauss[0].data.begin());
+}
+
+const Level<uint8_t> &Pyramid::Cache::etage_g(int etage)
+{
+    while((int)_gauss.size() <= etage)
     {
-        *(intermed+i)=*(rep+i);
+        const Level<uint8_t> &src = _gauss.back();
+        Level<uint8_t> dst(nextSize(src.width), nextSize(src.height));
+        etage_suiv_g(&src.data[0], &dst.data[0], src.width, src.height, _filtre);
+        _gauss.push_back(std::move(dst));
     }
-    for(i=etage_f;i>etage_rec;i--)
+    return _gauss[etage];
+}
+
+const Level<int16_t> &Pyramid::Cache::etage_l(int etage)
+{
+    etage_g(etage + 1);
+    if((int)_lap.size() <= etage) _lap.resize(etage + 1);
+    Level<int16_t> &diff = _lap[etage];
+    if(diff.width == 0)
     {
-        agrandir((intermed+q),(intermed+q-taille*taille*4),taille,taille,utile);
-        taille=taille*2;
-        q=q-taille*taille;
-        for(j=q;j<q+taille*taille;j++)
+        const Level<uint8_t> &g = _gauss[etage];
+        Level<uint8_t> agrandi(g.width, g.height);
+        agrandir(_gauss[etage + 1], agrandi, _filtre);
+        diff = Level<int16_t>(g.width, g.height);
+        for(size_t i = 0; i < g.data.size(); ++i)
         {
-            int value = rep[j];
-            if(value > 128) value = value - 256;
-            value = value + intermed[j];
-            if(value < 0) value = 0;
-            if(value > 255) value = 255;
-            intermed[j] = value;
+            diff.data[i] = g.data[i] - agrandi.data[i];
         }
     }
-    //printf("Entrez le nom du fichier de l'image reconstruite :");
-    //scanf("%s",nom);
-    //ecrire_image((intermed+q),nom,taille,taille);
-    returnval = new GrayscaleImage(taille, taille, intermed+q);
-    free(intermed);
-    free(rep);
-    return returnval;
+    return diff;
+}
+
+const Level<uint8_t> &Pyramid::Cache::gaussian(const Image *im, int etage, filtre &utile)
+{
+    check(im, utile);
+    return etage_g(etage);
+}
+
+const Level<int16_t> &Pyramid::Cache::laplacian(const Image *im, int etage, filtre &utile)
+{
+    check(im, utile);
+    return etage_l(etage);
+}
+
+Image *Pyramid::Cache::pyram_g(const Image *im, int etage_f, filtre &utile, string &to_print)
+{
+    check(im, utile);
+    int temp_etage_max = etage_max( im );
+    if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
+    if( etage_f < 1 ) etage_f = 1;
+
+    etage_g(etage_f);
+    Levels rep(_gauss.begin(), _gauss.begin() + etage_f + 1);
+    to_print = entropie_p(rep);
+    return reconstruction(rep, _width, _height);
+}
+
+Image *Pyramid::Cache::n_pyram_g(const Image *im, int etage_f, filtre &utile)
+{
+    check(im, utile);
+    int temp_etage_max = etage_max(im);
+    if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
+    if( etage_f < 1 ) etage_f = 1;
+
+    const Level<uint8_t> &etage = etage_g(etage_f);
+    GrayscaleImage *resImg = new GrayscaleImage(etage.width, etage.height);
+    std::copy(etage.data.begin(), etage.data.end(), resImg->begin());
+    return resImg;
+}
+
+ImageDouble *Pyramid::Cache::pyram_l(const Image *im, int etage_f, filtre &utile, string &to_print)
+{
+    check(im, utile);
+    int temp_etage_max = etage_max( im );
+    if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
+    if( etage_f < 1 ) etage_f = 1;
+
+    SignedLevels rep(etage_f + 1);
+    for(int k = 0; k < etage_f; ++k)
+    {
+        rep[k] = etage_l(k);
+    }
+    const Level<uint8_t> &sommet = _gauss[etage_f];
+    rep[etage_f] = Level<int16_t>(sommet.width, sommet.height);
+    std::copy(sommet.data.begin(), sommet.data.end(), rep[etage_f].data.begin());
+    to_print = entropie_p(rep);
+    return reconstruction(rep, _width, _height);
+}
+
+ImageDouble *Pyramid::Cache::n_pyram_l(const Image *im, int etage_f, filtre &utile)
+{
+    check(im, utile);
+    int temp_etage_max = etage_max(im) - 1;
+    if( etage_f > temp_etage_max ) etage_f = temp_etage_max;
+    if( etage_f < 0 ) etage_f = 0;
+
+    const Level<int16_t> &etage = etage_l(etage_f);
+    ImageDouble *resImg = new ImageDouble(etage.width, etage.height, 1);
+    std::copy(etage.data.begin(), etage.data.end(), resImg->begin());
+    return resImg;
 }
@@ -23,6 +23,7 @@
 #include <Image.h>
 #include <GrayscaleImage.h>
 #include <string>
+#include <vector>
 
 namespace Pyramid
 {
@@ -51,23 +52,93 @@ namespace Pyramid
         void copy_filter( const filtre &source, filtre &dest );
     };
 
+    /**
+     * One level of a pyramid, stored row by row.
+     * Each level is obtained by halving the previous one and rounding up,
+     * so that images of any size can be decomposed.
+     */
+    template<typename T>
+    struct Level {
+        Level() : width(0), height(0) {}
+        Level(int w, int h) : width(w), height(h), data(w * h) {}
+        T* row(int j) { return &data[j * width]; }
+        const T* row(int j) const { return &data[j * width]; }
+        int width, height;
+        std::vector<T> data;
+    };
+    typedef std::vector<Level<uint8_t> > Levels;
+    /* Pyramide Laplacienne : differences signees exactes, le dernier etage
+       etant l'etage Gaussien */
+    typedef std::vector<Level<int16_t> > SignedLevels;
+
+    inline int nextSize(int n) {
+        return (n + 1) / 2;
+    }
+
+    /* Symmetric border : the edge sample is not repeated (-1 -> 1, n -> n-2) */
+    inline int mirror(int i, int n) {
+        if(n <= 1) return 0;
+        while(i < 0 || i >= n) {
+            if(i < 0) i = -i;
+            if(i >= n) i = 2 * n - 2 - i;
+        }
+        return i;
+    }
+
+    /* Arrondi au plus proche, born a [0, 255] */
+    inline uint8_t arrondi(float v) {
+        return v <= 0.f ? 0 : (v >= 255.f ? 255 : (uint8_t)(v + 0.5f));
+    }
+
+    /**
+     * Pyramids of one image, whose levels are built on demand and kept for
+     * the next queries. The source (size and checksum) and the filter are
+     * checked at each query, and the levels are dropped if they changed.
+     */
+    class Cache
+    {
+    public:
+        Cache();
+        const Level<uint8_t> &gaussian(const imagein::Image *im, int etage, filtre &utile);
+        const Level<int16_t> &laplacian(const imagein::Image *im, int etage, filtre &utile);
+        imagein::Image *pyram_g(const imagein::Image *im, int etage_f, filtre &utile, std::string &to_print);
+        imagein::Image *n_pyram_g(const imagein::Image *im, int etage_f, filtre &utile);
+        imagein::ImageDouble *pyram_l(const imagein::Image *im, int etage_f, filtre &utile, std::string &to_print);
+        imagein::ImageDouble *n_pyram_l(const imagein::Image *im, int etage_f, filtre &utile);
+        void clear();
+    private:
+        void check(const imagein::Image *im, const filtre &utile);
+        const Level<uint8_t> &etage_g(int etage);
+        const Level<int16_t> &etage_l(int etage);
+        unsigned int _width, _height;
+        uint64_t _checksum;
+        filtre _filtre;
+        Levels _gauss;
+        SignedLevels _lap; // niveaux non encore calcules : largeur nulle
+    };
+
     void etage_suiv_g(const uint8_t *srcTab, uint8_t *dstTab, int srcWidth, int srcHeight, filtre &utile);
-    void pyram_g_n(uint8_t *rep, int nStage, long nbc, long nbl, const uint8_t *itab, filtre &utile);
-    void pyram_l_n (uint8_t *rep,int n, long nbc, long nbl, const uint8_t *itab, filtre &utile);
+    void pyram_g_n(Levels &rep, int nStage, int nbc, int nbl, const uint8_t *itab, filtre &utile);
+    void pyram_l_n(SignedLevels &rep, int n, int nbc, int nbl, const uint8_t *itab, filtre &utile);
+    imagein::GrayscaleImage *recomposition(const SignedLevels &pyra, int etage_rec, filtre &utile);
     imagein::Image *pyram_g(const imagein::GrayscaleImage *im, int etage_f, filtre &utile, std::string &to_print);
     imagein::Image *n_pyram_g(const imagein::Image *im, int etage_f, filtre &utile );
-    imagein::Image *pyram_l (const imagein::Image *im, int etage_f, filtre &utile, std::string &to_print);
-    imagein::Image *n_pyram_l(const imagein::Image *im, int etage_f, filtre &utile);
-    uint8_t filt_point_1d_lg(const uint8_t *tab,int cl, int x, int y, filtre &utile);
-    uint8_t filt_point_1d_cl(const uint8_t *tab,int lg,int cl, int x, int y, filtre &utile);
-    void filt_ligne(uint8_t *ligne,int taille_c, filtre &utile);
-    void filt_tab_cl(uint8_t *tab,int taille_c,int taille_l, filtre &utile);
-    void agrandir(uint8_t *petit,uint8_t *grand,int taille_c,int taille_l, filtre &utile);
-    void reconstruction(uint8_t *pyra,int n, long nbc, long nbl);
+    imagein::ImageDouble *pyram_l (const imagein::Image *im, int etage_f, filtre &utile, std::string &to_print);
+    imagein::ImageDouble *n_pyram_l(const imagein::Image *im, int etage_f, filtre &utile);
+    void agrandir(const Level<uint8_t> &petit, Level<uint8_t> &grand, filtre &utile);
+    int hauteur_pyramide(int nbl, int etage_f);
+    imagein::GrayscaleImage *reconstruction(const Levels &pyra, int nbc, int nbl);
+    imagein::ImageDouble *reconstruction(const SignedLevels &pyra, int nbc, int nbl);
+    void extraction(const imagein::Image *pyramid, int etage_f, SignedLevels &pyra);
+    void extraction(const imagein::ImageDouble *pyramid, int etage_f, SignedLevels &pyra);
     int etage_max(const imagein::Image *im);
+    int etage_max(int nbc, int nbl);
     float entropie2(const uint8_t *tab,int taille_c,int taille_l);
-    std::string entropie_p(const uint8_t *pyra,int etage_f,int nbc,int nbl);
+    std::string entropie_p(const Levels &pyra);
+    std::string entropie_p(const SignedLevels &pyra);
     imagein::Image* rebuild_interface(const imagein::Image *to_rebuild, int etage_f, int to_rebuild_to, filtre &utile );
+    imagein::Image* rebuild_interface(const imagein::ImageDouble *to_rebuild, int etage_f, int to_rebuild_to, filtre &utile );
+    imagein::Image *blend(const imagein::Image *a, const imagein::Image *b, const imagein::Image *mask, int etage_f, filtre &utile);
 }
 
 #endif // PYRAMID_H
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "RangeCoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+namespace
+{
+    const uint32_t TOTAL_MAX = 1 << 16; // au-dela les effectifs sont divises par deux
+    const uint32_t INCREMENT = 32;
+    const uint32_t HAUT = 1 << 24;      // renormalisation quand l'intervalle passe sous 2^24
+    const int NB_CONTEXTES = 16;
+
+    /* Effectifs adaptatifs des symboles [0, n[, tous non nuls */
+    class Modele
+    {
+      public:
+        Modele(int n) : _n(n), _effectif(n, 1), _arbre(n + 1, 0), _total(n) {
+            _masque = 1;
+            while(_masque * 2 <= n) _masque *= 2;
+            construire();
+        }
+        uint32_t total() const { return _total; }
+        uint32_t effectif(int s) const { return _effectif[s]; }
+        /* somme des effectifs des symboles [0, s[ */
+        uint32_t cumul(int s) const {
+            uint32_t c = 0;
+            for(int i = s; i > 0; i -= i & -i) c += _arbre[i];
+            return c;
+        }
+        /* symbole s tel que cumul(s) <= f < cumul(s + 1) */
+        int chercher(uint32_t f, uint32_t& cumulS) const {
+            int s = 0;
+            uint32_t c = 0;
+            for(int pas = _masque; pas > 0; pas >>= 1) {
+                if(s + pas <= _n && c + _arbre[s + pas] <= f) {
+                    s += pas;
+                    c += _arbre[s];
+                }
+            }
+            cumulS = c;
+            return s;
+        }
+        void ajouter(int s) {
+            _effectif[s] += INCREMENT;
+            _total += INCREMENT;
+            if(_total > TOTAL_MAX) {
+                _total = 0;
+                for(int k = 0; k < _n; ++k) {
+                    _effectif[k] = (_effectif[k] + 1) / 2;
+                    _total += _effectif[k];
+                }
+                construire();
+                return;
+            }
+            for(int i = s + 1; i <= _n; i += i & -i) _arbre[i] += INCREMENT;
+        }
+      private:
+        void construire() {
+            for(int i = 1; i <= _n; ++i) _arbre[i] = _effectif[i - 1];
+            for(int i = 1; i <= _n; ++i) {
+                const int j = i + (i & -i);
+                if(j <= _n) _arbre[j] += _arbre[i];
+            }
+        }
+        int _n, _masque;
+        vector<uint32_t> _effectif, _arbre;
+        uint32_t _total;
+    };
+
+    /* Codeur : bas sur 33 bits (retenue), les octets 0xFF en attente de la retenue etant comptes dans attente */
+    class Codeur
+    {
+      public:
+        Codeur(vector<uint8_t>& sortie) : _sortie(sortie), _bas(0), _intervalle(0xFFFFFFFFu), _cache(0), _attente(1) {}
+        void coder(uint32_t cumul, uint32_t effectif, uint32_t total) {
+            _intervalle /= total;
+            _bas += (uint64_t)cumul * _intervalle;
+            _intervalle *= effectif;
+            while(_intervalle < HAUT) {
+                _intervalle <<= 8;
+                decaler();
+            }
+        }
+        void terminer() {
+            for(int k = 0; k < 5; ++k) decaler();
+        }
+      private:
+        void decaler() {
+            if((uint32_t)_bas < 0xFF000000u || (_bas >> 32) != 0) {
+                const uint8_t retenue = (uint8_t)(_bas >> 32);
+                uint8_t octet = _cache;
+                do {
+                    _sortie.push_back(octet + retenue);
+                    octet = 0xFF;
+                } while(--_attente != 0);
+                _cache = (uint8_t)(_bas >> 24);
+            }
+            _attente++;
+            _bas = (_bas & 0x00FFFFFFu) << 8;
+        }
+        vector<uint8_t>& _sortie;
+        uint64_t _bas;
+        uint32_t _intervalle;
+        uint8_t _cache;
+        uint64_t _attente;
+    };
+
+    class Decodeur
+    {
+      public:
+        Decodeur(const vector<uint8_t>& entree) : _p(entree.empty() ? NULL : &entree[0]), _fin(_p + entree.size()), _code(0), _intervalle(0xFFFFFFFFu) {
+            for(int k = 0; k < 5; ++k) _code = (_code << 8) | lire();
+        }
+        uint32_t frequence(uint32_t total) {
+            _intervalle /= total;
+            return min(_code / _intervalle, total - 1);
+        }
+        void decoder(uint32_t cumul, uint32_t effectif) {
+            _code -= cumul * _intervalle;
+            _intervalle *= effectif;
+            while(_intervalle < HAUT) {
+                _code = (_code << 8) | lire();
+                _intervalle <<= 8;
+            }
+        }
+      private:
+        uint8_t lire() { return _p < _fin ? *_p++ : 0; }
+        const uint8_t *_p, *_fin;
+        uint32_t _code, _intervalle;
+    };
+
+    /* Contexte d'un symbole selon la valeur v de son voisin : classe de |v| (0, 1, 2, 3-4, 5-8...)
+     * pour des donnees signees, tranche de la dynamique sinon */
+    inline int contexteVoisin(int v, const RangeCoder::Flux& flux) {
+        if(flux.min < 0) {
+            const unsigned a = abs(v);
+            if(a <= 2) return a;
+            int c = 2;
+            for(unsigned b = a - 1; b > 1; b >>= 1) c++;
+            return min(c, NB_CONTEXTES - 1);
+        }
+        return (int)((int64_t)(v - flux.min) * NB_CONTEXTES / flux.nbValeurs);
+    }
+
+    /* Contexte du symbole i : voisin de gauche, ou du dessus en debut de ligne */
+    inline int contexte(const int *valeurs, size_t i, const RangeCoder::Flux& flux) {
+        if(!flux.contexte) return 0;
+        if(i % flux.largeur != 0) return contexteVoisin(valeurs[i - 1], flux);
+        if(i >= (size_t)flux.largeur) return contexteVoisin(valeurs[i - flux.largeur], flux);
+        return 0;
+    }
+}
+
+size_t RangeCoder::Flux::tailleOctets() const {
+    // min, nombre de valeurs et indicateur de contexte
+    return octets.size() + 9;
+}
+
+void RangeCoder::encode(const int *valeurs, size_t n, int largeur, bool contexte, Flux& flux) {
+    flux.min = 0;
+    flux.nbValeurs = 1;
+    flux.largeur = max(1, largeur);
+    flux.contexte = contexte;
+    flux.nbSymboles = n;
+    flux.octets.clear();
+    if(n == 0) return;
+
+    int vmin = valeurs[0], vmax = valeurs[0];
+    for(size_t i = 1; i < n; ++i) {
+        vmin = min(vmin, valeurs[i]);
+        vmax = max(vmax, valeurs[i]);
+    }
+    if((int64_t)vmax - vmin >= MAX_ALPHABET) {
+        throw "Error in RangeCoder::encode:\ntoo many different values";
+    }
+    flux.min = vmin;
+    flux.nbValeurs = vmax - vmin + 1;
+
+    vector<Modele> modeles(contexte ? NB_CONTEXTES : 1, Modele(flux.nbValeurs));
+    flux.octets.reserve(n / 2);
+    Codeur codeur(flux.octets);
+    for(size_t i = 0; i < n; ++i) {
+        Modele& m = modeles[::contexte(valeurs, i, flux)];
+        const int s = valeurs[i] - vmin;
+        codeur.coder(m.cumul(s), m.effectif(s), m.total());
+        m.ajouter(s);
+    }
+    codeur.terminer();
+}
+
+void RangeCoder::decode(const Flux& flux, int *valeurs) {
+    if(flux.nbSymboles == 0) return;
+    vector<Modele> modeles(flux.contexte ? NB_CONTEXTES : 1, Modele(flux.nbValeurs));
+    Decodeur decodeur(flux.octets);
+    for(size_t i = 0; i < flux.nbSymboles; ++i) {
+        Modele& m = modeles[::contexte(valeurs, i, flux)];
+        uint32_t cumul;
+        const int s = m.chercher(decodeur.frequence(m.total()), cumul);
+        decodeur.decoder(cumul, m.effectif(s));
+        m.ajouter(s);
+        valeurs[i] = s + flux.min;
+    }
+}
+
+string RangeCoder::codage(const int *valeurs, size_t n, int largeur, bool contexte) {
+    string returnval;
+    char buffer[255];
+    Flux flux;
+    vector<int> decodees(n);
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    encode(valeurs, n, largeur, contexte, flux);
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+    decode(flux, decodees.empty() ? NULL : &decodees[0]);
+    chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+    const bool exacte = equal(decodees.begin(), decodees.end(), valeurs);
+
+    const double dureeCodage = max(chrono::duration<double>(t1 - t0).count(), 1e-9);
+    const double dureeDecodage = max(chrono::duration<double>(t2 - t1).count(), 1e-9);
+    if(contexte) {
+        sprintf(buffer, "\n Codage arithmetique adaptatif, contexte du voisin de gauche (%d modeles)\n", NB_CONTEXTES);
+    }
+    else {
+        sprintf(buffer, "\n Codage arithmetique adaptatif\n");
+    }
+    returnval = returnval + buffer;
+    sprintf(buffer, " taille compressee = %lu octets\n", (unsigned long)flux.tailleOctets());
+    returnval = returnval + buffer;
+    sprintf(buffer, " debit reel = %.4f bits/pixel\n", n ? 8.0 * flux.tailleOctets() / n : 0.0);
+    returnval = returnval + buffer;
+    sprintf(buffer, " codage : %.1f Mpixels/s, decodage : %.1f Mpixels/s\n", n / dureeCodage * 1e-6, n / dureeDecodage * 1e-6);
+    returnval = returnval + buffer;
+    sprintf(buffer, " reconstruction exacte : %s\n", exacte ? "oui" : "NON");
+    returnval = returnval + buffer;
+    return returnval;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RANGECODER_H
+#define RANGECODER_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Adaptive range coder (arithmetic coding with byte renormalization) for
+ * integer values : gray levels, DPCM prediction errors, rounded DCT
+ * coefficients...
+ *
+ * Each value is coded with the frequencies of the values already coded,
+ * stored in a Fenwick tree so that the cumulative frequencies cost
+ * O(log n) for alphabets of several thousands values. Optionally the model
+ * is chosen according to the left neighbour (the upper one at the start of a
+ * row) : its magnitude for signed data, its value for positive data, so that
+ * the coder adapts to the local activity of the image.
+ */
+namespace RangeCoder
+{
+    static const int MAX_ALPHABET = 1 << 14; // nombre maximal de valeurs differentes
+
+    struct Flux {
+        int min;
+        int nbValeurs;      // valeurs de [min, min + nbValeurs[
+        int largeur;        // longueur des lignes, pour le voisin de gauche
+        bool contexte;
+        size_t nbSymboles;
+        std::vector<uint8_t> octets;
+        size_t tailleOctets() const; // donnees et en-tete
+    };
+
+    /* valeurs : n valeurs rangees par lignes de largeur valeurs */
+    void encode(const int *valeurs, size_t n, int largeur, bool contexte, Flux& flux);
+    void decode(const Flux& flux, int *valeurs);
+    /* Codage effectif : taille compressee, debits de codage et de decodage, verification de la reconstruction */
+    std::string codage(const int *valeurs, size_t n, int largeur, bool contexte);
+}
+
+#endif // RANGECODER_H
@@ -20,6 +20,7 @@
 #include "ClassAnalysisDialog.h"
 #include "ui_ClassAnalysisDialog.h"
 #include <QFileDialog>
+#include <algorithm>
 
 using namespace std;
 using namespace imagein;
@@ -31,6 +32,8 @@ ClassAnalysisDialog::ClassAnalysisDialog(QWidget *parent, const imagein::Image*
 
     _imgZoneSelector = new ImageZoneSelector(this, new Image(*img));
     ui->setupUi(this);
+    // the window must fit in the image once mirrored on each side
+    ui->windowBox->setMaximum(std::min<int>(ui->windowBox->maximum(), 2 * std::min(img->getWidth(), img->getHeight()) - 1));
     ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
     _label = new QLabel(tr("Please select the image's area to classify :"));
     ui->formLayout->addRow(_label);
@@ -48,7 +51,7 @@ ClassAnalysisDialog::~ClassAnalysisDialog()
 void ClassAnalysisDialog::on_fileButton_clicked()
 {
     QString filename;
-    if(isLearningStep()) {
+    if(isLearningStep() || isClusteringStep()) {
         filename = QFileDialog::getSaveFileName(this, "Save classification file", "", "Classification files (*.cff)");
     }
     else {
@@ -57,6 +60,18 @@ void ClassAnalysisDialog::on_fileButton_clicked()
     ui->fileEdit->setText(filename);
 }
 
+void ClassAnalysisDialog::on_folderButton_clicked()
+{
+    QString folder = QFileDialog::getExistingDirectory(this, "Images to classify", ui->folderEdit->text());
+    if(!folder.isEmpty()) {
+        ui->folderEdit->setText(folder);
+    }
+}
+
+void ClassAnalysisDialog::on_folderEdit_textChanged(QString) {
+    this->checkData();
+}
+
 void ClassAnalysisDialog::on_fileEdit_textChanged(QString /*str*/) {
 //    ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!str.isEmpty());
     this->checkData();
@@ -69,20 +84,50 @@ bool ClassAnalysisDialog::isLearningStep() const {
 bool ClassAnalysisDialog::isClassificationStep() const {
     return ui->stepBox->currentIndex() == 1;
 }
+
+bool ClassAnalysisDialog::isClusteringStep() const {
+    return ui->stepBox->currentIndex() == 3;
+}
+
+bool ClassAnalysisDialog::isBatchStep() const {
+    return ui->stepBox->currentIndex() == 4;
+}
+
 QString ClassAnalysisDialog::getFileName() const {
     return ui->fileEdit->text();
 }
 
+QString ClassAnalysisDialog::getFolder() const {
+    return ui->folderEdit->text();
+}
+
 int ClassAnalysisDialog::getWindowSize() const {
     return ui->windowBox->value();
 }
 
+bool ClassAnalysisDialog::useFeatureStack() const {
+    return ui->featureBox->currentIndex() == 1;
+}
+
+int ClassAnalysisDialog::getClusterCount() const {
+    return ui->clusterBox->value();
+}
+
 void ClassAnalysisDialog::on_stepBox_currentIndexChanged(int i) {
     _imgZoneSelector->setVisible(i == 0);
     _label->setVisible(i == 0);
     ui->formLayout->invalidate();
     ui->windowBox->setEnabled(i != 2);
     ui->windowLabel->setEnabled(i != 2);
+    // the features are stored in the file at the learning and clustering steps
+    ui->featureBox->setEnabled(i == 0 || i == 3);
+    ui->featureLabel->setEnabled(i == 0 || i == 3);
+    ui->clusterBox->setEnabled(i == 3);
+    ui->clusterLabel->setEnabled(i == 3);
+    ui->folderEdit->setEnabled(i == 4);
+    ui->folderButton->setEnabled(i == 4);
+    ui->folderLabel->setEnabled(i == 4);
+    this->checkData();
     this->adjustSize();
 }
 
@@ -95,5 +140,8 @@ void ClassAnalysisDialog::checkData() {
     if(this->isLearningStep()) {
         ok &= !_imgZoneSelector->isSelectionEmpty();
     }
+    if(this->isBatchStep()) {
+        ok &= !ui->folderEdit->text().isEmpty();
+    }
     ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(ok);
 }
@@ -36,8 +36,13 @@ public:
     ~ClassAnalysisDialog();
     bool isLearningStep() const;
     bool isClassificationStep() const;
+    bool isClusteringStep() const;
+    bool isBatchStep() const;
     QString getFileName() const;
+    QString getFolder() const;
     int getWindowSize() const;
+    bool useFeatureStack() const;
+    int getClusterCount() const;
     std::vector<imagein::Rectangle> getSelections() const;
 
 public slots:
@@ -46,6 +51,8 @@ public slots:
 private slots:
     void checkData();
     void on_fileButton_clicked();
+    void on_folderButton_clicked();
+    void on_folderEdit_textChanged(QString);
     void on_stepBox_currentIndexChanged(int);
 
 private:
@@ -26,6 +26,8 @@
 #include <Converter.h>
 #include <GrayscaleImage.h>
 #include <QMessageBox>
+#include <QDir>
+#include <QFileInfo>
 
 using namespace std;
 using namespace imagein;
@@ -49,14 +51,21 @@ void ClassAnalysisOp::operator()(const imagein::Image* img, const std::map<const
 
 
     if(dialog->isLearningStep()) {
-        FILE* f = fopen(dialog->getFileName().toLatin1(), "wt" );
+        FILE* f = fopen(dialog->getFileName().toLatin1(), "wb" );
         if(f == NULL) {
             QMessageBox::critical(NULL, "Error", "Could not open file for write access");
             return;
         }
         try {
             Image_t<double> *meanImg, *devImg;
-            ClassAnalysis::write_to_file(image, dialog->getSelections(), f, dialog->getWindowSize(), &meanImg, &devImg);
+            if(dialog->useFeatureStack()) {
+                vector<int> features;
+                for(int k = 0; k < ClassAnalysis::NB_FEATURES; ++k) features.push_back(k);
+                ClassAnalysis::write_features_to_file(image, dialog->getSelections(), f, dialog->getWindowSize(), features, &meanImg, &devImg);
+            }
+            else {
+                ClassAnalysis::write_to_file(image, dialog->getSelections(), f, dialog->getWindowSize(), &meanImg, &devImg);
+            }
             outDoubleImage(meanImg, qApp->translate("ClassAnalysis", "mean").toStdString());
             outDoubleImage(devImg, qApp->translate("ClassAnalysis", "standard deviation").toStdString());
         }
@@ -67,7 +76,7 @@ void ClassAnalysisOp::operator()(const imagein::Image* img, const std::map<const
         fclose(f);
     }
     else if(dialog->isClassificationStep()) {
-        FILE* f = fopen(dialog->getFileName().toLatin1(), "rt" );
+        FILE* f = fopen(dialog->getFileName().toLatin1(), "rb" );
         if(f == NULL) {
             QMessageBox::critical(NULL, "Error", "Could not open file for read access");
             return;
@@ -76,6 +85,33 @@ void ClassAnalysisOp::operator()(const imagein::Image* img, const std::map<const
             Image_t<double> *meanImg, *devImg;
             Image *resImg = ClassAnalysis::classify_from_file(image, f, dialog->getWindowSize(), &meanImg, &devImg);
             outImage(resImg, qApp->translate("ClassAnalysis", "classified").toStdString());
+            // a FEATURES_MAHALANOBIS model does not necessarily use the mean or the standard deviation
+            if(meanImg != NULL) outDoubleImage(meanImg, qApp->translate("ClassAnalysis", "mean").toStdString());
+            if(devImg != NULL) outDoubleImage(devImg, qApp->translate("ClassAnalysis", "standard deviation").toStdString());
+        }
+        catch(const char*e) {
+            QMessageBox::critical(NULL, "Error", e);
+            return;
+        }
+        fclose(f);
+    }
+    else if(dialog->isClusteringStep()) {
+        FILE* f = fopen(dialog->getFileName().toLatin1(), "wb" );
+        if(f == NULL) {
+            QMessageBox::critical(NULL, "Error", "Could not open file for write access");
+            return;
+        }
+        try {
+            vector<int> features;
+            features.push_back(ClassAnalysis::MEAN);
+            features.push_back(ClassAnalysis::STDEV);
+            if(dialog->useFeatureStack()) {
+                for(int k = ClassAnalysis::STDEV + 1; k < ClassAnalysis::NB_FEATURES; ++k) features.push_back(k);
+            }
+            Image *resImg;
+            Image_t<double> *meanImg, *devImg;
+            ClassAnalysis::kmeans_to_file(image, f, dialog->getWindowSize(), features, dialog->getClusterCount(), &resImg, &meanImg, &devImg);
+            outImage(resImg, qApp->translate("ClassAnalysis", "classified").toStdString());
             outDoubleImage(meanImg, qApp->translate("ClassAnalysis", "mean").toStdString());
             outDoubleImage(devImg, qApp->translate("ClassAnalysis", "standard deviation").toStdString());
         }
@@ -85,8 +121,54 @@ void ClassAnalysisOp::operator()(const imagein::Image* img, const std::map<const
         }
         fclose(f);
     }
+    else if(dialog->isBatchStep()) {
+        FILE* f = fopen(dialog->getFileName().toLatin1(), "rb" );
+        if(f == NULL) {
+            QMessageBox::critical(NULL, "Error", "Could not open file for read access");
+            return;
+        }
+        ClassAnalysis::Model model;
+        bool valid = ClassAnalysis::read_model(f, model);
+        fclose(f);
+        if(!valid) {
+            QMessageBox::critical(NULL, "Error", "Not a valid classification file");
+            return;
+        }
+
+        // the results are saved as PNG in the "classified" subfolder, the source extension being
+        // kept in the name so that a.png and a.jpg do not overwrite each other (a_png.png, a_jpg.png)
+        QDir folder(dialog->getFolder());
+        QStringList files = folder.entryList(QStringList() << "*.png" << "*.jpg" << "*.jpeg" << "*.bmp" << "*.vff", QDir::Files, QDir::Name);
+        if(files.isEmpty()) {
+            QMessageBox::critical(NULL, "Error", "No image to classify in this folder");
+            return;
+        }
+        if(!folder.mkpath("classified")) {
+            QMessageBox::critical(NULL, "Error", "Could not create the \"classified\" folder");
+            return;
+        }
+        QDir outFolder(folder.filePath("classified"));
+        vector<string> inputs, outputs, errors;
+        for(QStringList::const_iterator it = files.begin(); it != files.end(); ++it) {
+            inputs.push_back(folder.filePath(*it).toLocal8Bit().constData());
+            QFileInfo info(*it);
+            outputs.push_back(outFolder.filePath(info.completeBaseName() + "_" + info.suffix() + ".png").toLocal8Bit().constData());
+        }
+        try {
+            int nbSaved = ClassAnalysis::classify_batch(model, dialog->getWindowSize(), inputs, outputs, errors);
+            string s = qApp->translate("ClassAnalysis", "%1 of %2 images classified into %3\n").arg(nbSaved).arg(files.size()).arg(outFolder.path()).toStdString();
+            for(size_t i = 0; i < errors.size(); ++i) {
+                if(!errors[i].empty()) s += inputs[i] + " : " + errors[i] + "\n";
+            }
+            outText(s);
+        }
+        catch(const char*e) {
+            QMessageBox::critical(NULL, "Error", e);
+            return;
+        }
+    }
     else {
-        FILE* f = fopen(dialog->getFileName().toLatin1(), "rt" );
+        FILE* f = fopen(dialog->getFileName().toLatin1(), "rb" );
         if(f == NULL) {
             QMessageBox::critical(NULL, "Error", "Could not open file for read access");
             return;
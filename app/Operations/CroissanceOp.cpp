@@ -21,6 +21,7 @@
 #include <QFormLayout>
 #include <QComboBox>
 #include <QSpinBox>
+#include <QCheckBox>
 #include <QDialogButtonBox>
 #include <QApplication>
 
@@ -66,9 +67,19 @@ void CroissanceOp::operator()(const imagein::Image* img, const std::map<const im
     layout->insertRow(0, qApp->translate("CroissanceOp", "Threshold : "), thresholdBox);
     layout->insertRow(1, qApp->translate("CroissanceOp", "Initial germ : "), initBox);
     layout->insertRow(2, qApp->translate("CroissanceOp", "Stopping point : "), stopBox);
+    QCheckBox* tilesBox = new QCheckBox(qApp->translate("CroissanceOp", "Parallel (tiles)"));
+    layout->insertRow(3, QString(), tilesBox);
+    QSpinBox* mergeThresholdBox = new QSpinBox();
+    mergeThresholdBox->setRange(0, 255);
+    mergeThresholdBox->setSpecialValueText(qApp->translate("CroissanceOp", "None"));
+    QSpinBox* targetBox = new QSpinBox();
+    targetBox->setRange(0, 1000000);
+    targetBox->setSpecialValueText(qApp->translate("CroissanceOp", "None"));
+    layout->insertRow(4, qApp->translate("CroissanceOp", "Merge threshold : "), mergeThresholdBox);
+    layout->insertRow(5, qApp->translate("CroissanceOp", "Target number of areas : "), targetBox);
 
     QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok|QDialogButtonBox::Cancel, Qt::Horizontal, dialog);
-    layout->insertRow(3, buttonBox);
+    layout->insertRow(6, buttonBox);
     QObject::connect(buttonBox, SIGNAL(accepted()), dialog, SLOT(accept()));
     QObject::connect(buttonBox, SIGNAL(rejected()), dialog, SLOT(reject()));
 
@@ -79,25 +90,35 @@ void CroissanceOp::operator()(const imagein::Image* img, const std::map<const im
     GrayscaleImage* image = Converter<GrayscaleImage>::convert(*img);
 
     Croissance cr;
-    Image *lum, *color;
-    int nbRegion;
+    Image *lum = NULL, *color = NULL;
+    int nbRegion = 0;
     int threshold = thresholdBox->value();
-    if(initBox->currentIndex() == 0) {
+    // avec fusion, les images de sortie ne sont construites qu'apres la fusion
+    const bool merge = mergeThresholdBox->value() > 0 || targetBox->value() > 0;
+    Image **lumOut = merge ? NULL : &lum, **colorOut = merge ? NULL : &color;
+    if(tilesBox->isChecked()) {
+        nbRegion = cr.croissanceTuiles(image, threshold, initBox->currentIndex() == 1, stopBox->currentIndex() == 0, lumOut, colorOut);
+    }
+    else if(initBox->currentIndex() == 0) {
         if(stopBox->currentIndex() == 0) {
-            nbRegion = cr.croissance1a(image, threshold, &lum, &color);
+            nbRegion = cr.croissance1a(image, threshold, lumOut, colorOut);
         }
         else if(stopBox->currentIndex() == 1) {
-            nbRegion = cr.croissance1b(image, threshold, &lum, &color);
+            nbRegion = cr.croissance1b(image, threshold, lumOut, colorOut);
         }
     }
     else if (initBox->currentIndex() == 1) {
         if(stopBox->currentIndex() == 0) {
-            nbRegion = cr.croissance2a(image, threshold, &lum, &color);
+            nbRegion = cr.croissance2a(image, threshold, lumOut, colorOut);
         }
         else if(stopBox->currentIndex() == 1) {
-            nbRegion = cr.croissance2b(image, threshold, &lum, &color);
+            nbRegion = cr.croissance2b(image, threshold, lumOut, colorOut);
         }
     }
+    if(merge) {
+        outText(qApp->translate("CroissanceOp", "Number of area before merging : %1").arg(nbRegion).toStdString());
+        nbRegion = cr.fusionRegions(image, nbRegion, mergeThresholdBox->value(), targetBox->value(), &lum, &color);
+    }
     outImage(lum, qApp->translate("CroissanceOp", "Luminance").toStdString());
     outImage(color, qApp->translate("CroissanceOp", "Color").toStdString());
     outText(qApp->translate("CroissanceOp", "Total number of area : %1").arg(nbRegion).toStdString());
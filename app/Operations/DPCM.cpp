@@ -21,6 +21,8 @@
 #include <cstring>
 #include <cstdio>
 #include <cmath>
+#include <map>
+#include <Parallel.h>
 
 using namespace std;
 using namespace imagein;
@@ -46,123 +48,272 @@ DPCM::~DPCM()
 
 }
 
+namespace
+{
+    /* Codage DPCM d'un plan de w x h echantillons de [vmin, vmax] separes de pas elements (nombre de canaux)
+     * dans src, err et recons. erreur et reconstruction donnent, pour chaque erreur de prediction d + dmax,
+     * l'erreur quantifiee et l'ecart a ajouter a la prediction. La premiere ligne et la premiere colonne sont
+     * transmises telles quelles. Chaque pixel dependant du pixel reconstruit precedent, la boucle est sequentielle. */
+    template<DPCM::Prediction P, typename T>
+    void coderPlan(const T *src, int w, int h, int pas, double Q, int vmin, int vmax, int dmax, const int *erreur, const int *reconstruction, double *err, T *recons, uint64_t *histo) {
+        const long ligne = (long)w * pas;
+        for(long k = 0; k < ligne; k += pas) {
+            err[k] = 0.;
+            recons[k] = src[k];
+        }
+        for(int i = 1; i < h; i++) {
+            const T *o = src + i * ligne, *oHaut = o - ligne;
+            T *r = recons + i * ligne;
+            const T *rHaut = r - ligne;
+            double *e = err + i * ligne;
+            e[0] = 0.;
+            r[0] = o[0];
+            for(long k = pas; k < ligne; k += pas) {
+                int pred;
+                switch(P) {
+                case DPCM::PX_EQ_A:
+                    pred = r[k - pas];
+                    break;
+                case DPCM::PX_EQ_B:
+                    pred = rHaut[k];
+                    break;
+                case DPCM::PX_EQ_APC:
+                    pred = (r[k - pas] + rHaut[k]) / 2;
+                    break;
+                default: {
+                    // Graham modifie, sur l'image originale
+                    const float A = o[k - pas], B = oHaut[k - pas], C = oHaut[k];
+                    if( ((fabs(B-C) - Q) <= fabs(B-A)) &&
+                            (fabs(B-A) <= (fabs(B-C) + Q)) ) {
+                        pred = (T)((A + C) / 2);
+                    } else {
+                        pred = fabs(B-A) > fabs(B-C) ? (T)A : (T)C;
+                    }
+                    break;
+                }
+                }
+                const int d = o[k] - pred + dmax;
+                histo[d]++;
+                e[k] = erreur[d];
+                const int v = pred + reconstruction[d];
+                // Crop the value in [vmin,vmax]
+                r[k] = v > vmax ? vmax : v < vmin ? vmin : v;
+            }
+        }
+    }
+
+    template<typename T>
+    void coder(DPCM::Prediction p, const T *src, int w, int h, int pas, double Q, int vmin, int vmax, int dmax, const int *erreur, const int *reconstruction, double *err, T *recons, uint64_t *histo) {
+        switch(p) {
+        case DPCM::PX_EQ_A:
+            coderPlan<DPCM::PX_EQ_A>(src, w, h, pas, Q, vmin, vmax, dmax, erreur, reconstruction, err, recons, histo);
+            break;
+        case DPCM::PX_EQ_B:
+            coderPlan<DPCM::PX_EQ_B>(src, w, h, pas, Q, vmin, vmax, dmax, erreur, reconstruction, err, recons, histo);
+            break;
+        case DPCM::PX_EQ_APC:
+            coderPlan<DPCM::PX_EQ_APC>(src, w, h, pas, Q, vmin, vmax, dmax, erreur, reconstruction, err, recons, histo);
+            break;
+        case DPCM::PX_EQ_Q:
+            coderPlan<DPCM::PX_EQ_Q>(src, w, h, pas, Q, vmin, vmax, dmax, erreur, reconstruction, err, recons, histo);
+            break;
+        }
+    }
+
+    /* Transformation couleur reversible YCoCg-R des trois premiers canaux de n canaux entrelaces :
+     * Y dans [0, 255], Co et Cg dans [-255, 255] ; les canaux suivants sont recopies */
+    void versYCoCg(const uint8_t *rgb, int w, int h, int n, int16_t *ycocg) {
+        Parallel::forBands(0, h, [=](int debut, int fin) {
+            for(long k = (long)debut * w * n; k < (long)fin * w * n; k += n) {
+                const int co = rgb[k] - rgb[k + 2];
+                const int t = rgb[k + 2] + (co >> 1);
+                const int cg = rgb[k + 1] - t;
+                ycocg[k] = t + (cg >> 1);
+                ycocg[k + 1] = co;
+                ycocg[k + 2] = cg;
+                for(int c = 3; c < n; c++) ycocg[k + c] = rgb[k + c];
+            }
+        }, 64);
+    }
+
+    inline uint8_t borner(int v) {
+        return v > 255 ? 255 : v < 0 ? 0 : v;
+    }
+
+    /* Transformation inverse ; les valeurs reconstruites hors de [0, 255] sont ecretees */
+    void depuisYCoCg(const int16_t *ycocg, int w, int h, int n, uint8_t *rgb) {
+        Parallel::forBands(0, h, [=](int debut, int fin) {
+            for(long k = (long)debut * w * n; k < (long)fin * w * n; k += n) {
+                const int co = ycocg[k + 1], cg = ycocg[k + 2];
+                const int t = ycocg[k] - (cg >> 1);
+                const int b = t - (co >> 1);
+                rgb[k] = borner(b + co);
+                rgb[k + 1] = borner(cg + t);
+                rgb[k + 2] = borner(b);
+                for(int c = 3; c < n; c++) rgb[k + c] = borner(ycocg[k + c]);
+            }
+        }, 64);
+    }
+
+    /* Entropie des erreurs quantifiees : plusieurs erreurs peuvent avoir la meme valeur quantifiee */
+    double entropie(const uint64_t *histo, const int *erreur, int taille) {
+        map<int, uint64_t> effectifs;
+        uint64_t nbpt = 0;
+        for(int d = 0; d < taille; d++) {
+            if(histo[d] != 0) {
+                effectifs[erreur[d]] += histo[d];
+                nbpt += histo[d];
+            }
+        }
+        double h = 0.;
+        for(map<int, uint64_t>::const_iterator it = effectifs.begin(); it != effectifs.end(); ++it) {
+            const double p = (double)it->second / nbpt;
+            h -= p * log(p) / log(2.0);
+        }
+        return h;
+    }
+}
+
 string DPCM::execute( const GrayscaleImage *im, Prediction prediction_alg, imagein::ImageDouble **err_image, Image **recons_image, double Q ) {
-    char buffer[255];
+    vector<const GrayscaleImage*> images(1, im);
+    vector<ImageDouble*> err_images;
+    vector<Image*> recons_images;
+    vector<string> reports;
+    execute(images, prediction_alg, err_images, recons_images, reports, Q);
+    *err_image = err_images[0];
+    *recons_image = recons_images[0];
+    return reports[0];
+}
+
+void DPCM::execute( const vector<const GrayscaleImage*>& images, Prediction prediction_alg, vector<ImageDouble*>& err_images, vector<Image*>& recons_images, vector<string>& reports, double Q ) {
     if( quantdef == NULL ) {
         throw "Error in DPCM::execute:\nquantdef = NULL";
     }
-    string returnval;
-    int imgHeight,imgWidth,pred,ier,ireco,icode;
-
-    float pi[512],nbpt = 0;
-    double h = 0.;
-
-    imgHeight = im->getHeight();
-    imgWidth = im->getWidth();
 
     /* initialisation de la loi de quantification */
     set_levels();
     codlq(0);
+    int erreur[511], reconstruction[511];
+    table_codage(255, erreur, reconstruction);
 
-    /* allocation mmoire pour l'image d'erreur de prdiction */
-    ImageDouble *error_prediction_image = new ImageDouble(imgWidth, imgHeight, 1);
-    Image *reconstructed_image = new GrayscaleImage(*im);
-
-    // Init the error image with 0 values
-    for(int i=0; i < imgHeight; i++) {
-        for(int j=0; j< imgWidth; j++) {
-            error_prediction_image->setPixelAt(j, i, 0);
-        }
+    /* allocation memoire pour les images d'erreur de prediction et les images reconstruites */
+    const int nbImages = images.size();
+    err_images.assign(nbImages, NULL);
+    recons_images.assign(nbImages, NULL);
+    reports.assign(nbImages, string());
+    for(int k = 0; k < nbImages; k++) {
+        err_images[k] = new ImageDouble(images[k]->getWidth(), images[k]->getHeight(), 1);
+        recons_images[k] = new GrayscaleImage(images[k]->getWidth(), images[k]->getHeight());
     }
 
-    /* mise a 0 du tableau des probas servant pour le calcul de
-    l'entropie de l'erreur de prdiction */
-    for(int i=0 ; i<512 ; i++) pi[i]= 0.;
+    /* codage des images, une par thread ; histogramme des erreurs de prediction de chaque image */
+    vector<uint64_t> histos(nbImages * 511, 0);
+    Parallel::forEach(0, nbImages, [&](int k) {
+        coder(prediction_alg, images[k]->begin(), images[k]->getWidth(), images[k]->getHeight(), 1, Q, 0, 255, 255,
+              erreur, reconstruction, err_images[k]->begin(), recons_images[k]->begin(), &histos[k * 511]);
+    });
 
-    /* codage de l'image */
-    for(int i=1; i<imgHeight ; i++)
-    {
-        for(int j=1; j<imgWidth ; j++)
-        {
-            switch (prediction_alg) {
-            int AplusC;
-            float A,B,C;
-
-            case PX_EQ_A:
-                pred = reconstructed_image->getPixelAt(j-1, i);
-                break;
-            case PX_EQ_B:
-                pred = reconstructed_image->getPixelAt(j, i-1);
-                break;
-            case PX_EQ_APC:
-                AplusC = reconstructed_image->getPixelAt(j-1, i) + reconstructed_image->getPixelAt(j, i-1);
-                pred = AplusC / 2;
-                break;
-            case PX_EQ_Q:
-                /*
-                Modified Graham's Algorithm:
-                if |B-C| - Q <= |B-A| <= |B-C| + Q
-                        P(X) = (A+C)/2
-                else
-                    if |B-A| > |B-C|
-                            P(X) = A
-                    else
-                            P(X) = C
-                */
-                A = im->getPixelAt(j-1, i);
-                B = im->getPixelAt(j-1, i-1);
-                C = im->getPixelAt(j,   i-1);
-
-                if( ((fabs(B-C) - Q) <= fabs(B-A)) &&
-                        (fabs(B-A) <= (fabs(B-C) + Q)) ) {
-                    pred = (uint8_t)((A + C) / 2);
-                } else {
-                    if( fabs(B-A) > fabs(B-C) ) {
-                        pred = (uint8_t)A;
-                    } else {
-                        pred = (uint8_t)C;
-                    }
-                }
-                break;
-            default:
-                break;
-            }
+    for(int k = 0; k < nbImages; k++) {
+        reports[k] = rapport(&histos[k * 511], erreur);
+    }
+}
 
-            depth_default_t thePixel = reconstructed_image->getPixelAt(j, i);
-            ier = thePixel - pred;
-            ier = quantdef->valueOf(ier);
+string DPCM::executeColor( const Image *im, Prediction prediction_alg, ImageDouble **err_image, Image **recons_image, double Q, bool ycocg ) {
+    if( quantdef == NULL ) {
+        throw "Error in DPCM::executeColor:\nquantdef = NULL";
+    }
+    const int w = im->getWidth(), h = im->getHeight(), n = im->getNbChannels();
+    ycocg = ycocg && n >= 3;
 
-            codec(0, ier, &icode, &ireco);
+    /* tables de codage des erreurs de [-255, 255] (niveaux, Y) et de [-510, 510] (Co, Cg) */
+    set_levels();
+    codlq(0);
+    const int TAILLE = 1021;
+    vector<int> erreur8(511), reco8(511), erreur9(TAILLE), reco9(TAILLE);
+    table_codage(255, &erreur8[0], &reco8[0]);
+    if(ycocg) table_codage(510, &erreur9[0], &reco9[0]);
 
-            pi[ier+255]++;      /* proba associe a l'erreur de prdiction */
-            nbpt++;
+    ImageDouble *err = new ImageDouble(w, h, n);
+    Image *recons = new Image(w, h, n);
+    *err_image = err;
+    *recons_image = recons;
 
-            error_prediction_image->setPixelAt(j, i, ier);
+    /* codage des canaux entrelaces, un par thread */
+    vector<uint64_t> histos(n * TAILLE, 0);
+    if(!ycocg) {
+        Parallel::forEach(0, n, [&](int c) {
+            coder(prediction_alg, im->begin() + c, w, h, n, Q, 0, 255, 255,
+                  &erreur8[0], &reco8[0], err->begin() + c, recons->begin() + c, &histos[c * TAILLE]);
+        });
+    }
+    else {
+        vector<int16_t> transformee((size_t)w * h * n), reconstruite((size_t)w * h * n);
+        versYCoCg(im->begin(), w, h, n, &transformee[0]);
+        Parallel::forEach(0, n, [&](int c) {
+            const bool chroma = c == 1 || c == 2;
+            coder(prediction_alg, &transformee[c], w, h, n, Q, chroma ? -255 : 0, 255, chroma ? 510 : 255,
+                  chroma ? &erreur9[0] : &erreur8[0], chroma ? &reco9[0] : &reco8[0],
+                  err->begin() + c, &reconstruite[c], &histos[c * TAILLE]);
+        });
+        depuisYCoCg(&reconstruite[0], w, h, n, recons->begin());
+    }
 
-            int tempvalue = pred + ireco;
-            // Crop the value in [0,255]
-            reconstructed_image->setPixelAt(j, i, tempvalue > 255 ? 255 : tempvalue < 0 ? 0 : tempvalue);
+    /* entropie de chaque canal sur les (w-1)(h-1) pixels predits ; le debit total est leur somme, en bits par
+     * pixel couleur, la premiere ligne et la premiere colonne etant transmises sur 8 bits (9 pour Co et Cg) */
+    char buffer[255];
+    string returnval;
+    const char* nomsRGB[] = {"R", "G", "B", "A"};
+    const char* nomsYCoCg[] = {"Y", "Co", "Cg", "A"};
+    sprintf(buffer, "\nCodage DPCM de chaque canal%s\n", ycocg ? " apres transformation reversible YCoCg-R" : "");
+    returnval = returnval + buffer;
+    double total = 0.;
+    int bitsBord = 0;
+    for(int c = 0; c < n; c++) {
+        const bool chroma = ycocg && (c == 1 || c == 2);
+        const double hc = entropie(&histos[c * TAILLE], chroma ? &erreur9[0] : &erreur8[0], chroma ? TAILLE : 511);
+        total += hc;
+        bitsBord += chroma ? 9 : 8;
+        if(n == 1) {
+            sprintf(buffer, " canal unique : entropie = %lf bits/pixel\n", hc);
         }
+        else if(n == 3 || n == 4) {
+            sprintf(buffer, " canal %s : entropie = %lf bits/pixel\n", ycocg ? nomsYCoCg[c] : nomsRGB[c], hc);
+        }
+        else {
+            sprintf(buffer, " canal %d : entropie = %lf bits/pixel\n", c, hc);
+        }
+        returnval = returnval + buffer;
     }
+    const double nbPredits = w > 0 && h > 0 ? (double)(w - 1) * (h - 1) : 0., nbBord = (double)w * h - nbPredits;
+    sprintf(buffer, " total : %lf bits/pixel (%lf bits/echantillon), soit %lu octets avec les %lu pixels du bord\n", total, total / n,
+            (unsigned long)ceil((total * nbPredits + bitsBord * nbBord) / 8), (unsigned long)nbBord);
+    returnval = returnval + buffer;
+    returnval = returnval + "\n";
+    returnval = returnval + print_iloiqu();
+    return returnval;
+}
 
-    /* calcul de l'entropie de l'image d'erreur de prediction */
-    for(int i=0 ; i < 512 ; i++)
-    {
-        if(pi[i] != 0) {
-            pi[i] /= nbpt;
-            h -= (double)pi[i] * log((double)pi[i])/log((double)2.0);
-        }
+void DPCM::table_codage(int dmax, int *erreur, int *reconstruction) {
+    // la quantification et le codeur sont appliques une fois pour toutes aux 2 dmax + 1 erreurs possibles
+    for(int d = -dmax; d <= dmax; d++) {
+        int icode;
+        erreur[d + dmax] = quantdef->valueOf(d);
+        codec(0, erreur[d + dmax], &icode, &reconstruction[d + dmax]);
     }
+}
+
+string DPCM::rapport(const uint64_t *histo, const int *erreur) {
+    char buffer[255];
+    string returnval;
+
+    /* calcul de l'entropie de l'image d'erreur de prediction */
+    const double h = entropie(histo, erreur, 511);
 
-    /* affichage des rsultats */
+    /* affichage des resultats */
     sprintf(buffer, "\nL'entropie de l'image d'erreur de prediction vaut : %lf\n",h);
     returnval = returnval + buffer;
     returnval = returnval + "\n";
     returnval = returnval + print_iloiqu();
-
-    /* libration de la mmoire alloue */
-    *err_image = error_prediction_image;
-    *recons_image = reconstructed_image;
     return returnval;
 }
 
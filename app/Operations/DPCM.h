@@ -21,6 +21,7 @@
 #define DPCM_H
 
 #include <string>
+#include <vector>
 #include <GrayscaleImage.h>
 #include "Quantification.h"
 
@@ -31,9 +32,16 @@ public:
     enum Prediction {PX_EQ_A, PX_EQ_B, PX_EQ_APC, PX_EQ_Q};
     virtual ~DPCM();
     std::string execute(const imagein::GrayscaleImage *im, Prediction prediction_alg, imagein::ImageDouble **err_image, imagein::Image **recons_image, double Q = 0 );
+    /* Codage de plusieurs images a la fois, en parallele ; reports[i] est le compte rendu de l'image i */
+    void execute(const std::vector<const imagein::GrayscaleImage*>& images, Prediction prediction_alg, std::vector<imagein::ImageDouble*>& err_images, std::vector<imagein::Image*>& recons_images, std::vector<std::string>& reports, double Q = 0 );
+    /* Codage de chaque canal de im, en parallele, eventuellement apres la transformation couleur
+     * reversible YCoCg-R des trois premiers canaux ; err_image a autant de canaux que im */
+    std::string executeColor(const imagein::Image *im, Prediction prediction_alg, imagein::ImageDouble **err_image, imagein::Image **recons_image, double Q = 0, bool ycocg = false );
     void setQuantification( Quantification* tquantdef );
 private:
     std::string print_iloiqu();
+    void table_codage(int dmax, int *erreur, int *reconstruction);
+    std::string rapport(const uint64_t *histo, const int *erreur);
     Quantification* quantdef;
     void codlq(int m);
     void codec(int nlq,int ier,int *icode,int *ireco);
@@ -65,6 +65,22 @@ DPCM::Prediction DPCMDialog::getPrediction() const {
     else return DPCM::PX_EQ_A;
 }
 
+bool DPCMDialog::isLossless() const {
+    return ui->predictRadioLossless->isChecked();
+}
+
 double DPCMDialog::getQ() const {
     return ui->qSpinBox->value();
 }
+
+bool DPCMDialog::allImages() const {
+    return ui->allImagesBox->isChecked();
+}
+
+bool DPCMDialog::encodeColor() const {
+    return ui->colorBox->isChecked();
+}
+
+bool DPCMDialog::useYCoCg() const {
+    return ui->colorBox->isChecked() && ui->ycocgBox->isChecked();
+}
@@ -38,6 +38,10 @@ public:
     Quantification* getQuantification() const;
     DPCM::Prediction getPrediction() const;
     double getQ() const;
+    bool isLossless() const;
+    bool allImages() const;
+    bool encodeColor() const;
+    bool useYCoCg() const;
     
 private slots:
     void on_quantBrowseButton_clicked();
@@ -22,9 +22,11 @@
 #include <QApplication>
 #include "DPCMDialog.h"
 #include "DPCM.h"
+#include "../Algorithms/LocoI.h"
 #include <QMessageBox>
 #include <GrayscaleImage.h>
 #include <Converter.h>
+#include <algorithm>
 
 using namespace std;
 using namespace imagein;
@@ -37,7 +39,7 @@ bool DPCMEncodingOp::needCurrentImg() const {
     return true;
 }
 
-void DPCMEncodingOp::operator()(const imagein::Image* img, const std::map<const imagein::Image*, std::string>&) {
+void DPCMEncodingOp::operator()(const imagein::Image* img, const std::map<const imagein::Image*, std::string>& imgList) {
 
     DPCMDialog* dialog = new DPCMDialog(QApplication::activeWindow());
     QDialog::DialogCode code = static_cast<QDialog::DialogCode>(dialog->exec());
@@ -45,6 +47,24 @@ void DPCMEncodingOp::operator()(const imagein::Image* img, const std::map<const
 
     if(code != QDialog::Accepted) return;
 
+    if(dialog->isLossless()) {
+        // pas de loi de quantification : les images sont codees une par une pour mesurer les debits
+        if(dialog->allImages()) {
+            for(map<const Image*, string>::const_iterator it = imgList.begin(); it != imgList.end(); ++it) {
+                GrayscaleImage* image = Converter<GrayscaleImage>::convert(*it->first);
+                outText(it->second + " :");
+                losslessEncoding(image, " - " + it->second);
+                delete image;
+            }
+        }
+        else {
+            GrayscaleImage* image = Converter<GrayscaleImage>::convert(*img);
+            losslessEncoding(image, "");
+            delete image;
+        }
+        return;
+    }
+
     DPCM micd;
     try {
         micd.setQuantification(dialog->getQuantification());
@@ -54,11 +74,65 @@ void DPCMEncodingOp::operator()(const imagein::Image* img, const std::map<const
                               qApp->translate("DPCM", "The specified quantification file could not be opened !"));
         return;
     }
+    if(dialog->encodeColor()) {
+        // les canaux de chaque image sont codes en parallele, sans conversion en niveaux de gris
+        map<const Image*, string> images;
+        if(dialog->allImages()) images = imgList;
+        else images[img] = "";
+        for(map<const Image*, string>::const_iterator it = images.begin(); it != images.end(); ++it) {
+            const string suffixe = it->second.empty() ? "" : " - " + it->second;
+            Image *reconstructedImage;
+            ImageDouble *errorImage;
+            string s = micd.executeColor(it->first, dialog->getPrediction(), &errorImage, &reconstructedImage, dialog->getQ(), dialog->useYCoCg());
+            outText(it->second.empty() ? s : it->second + " :\n" + s);
+            outDoubleImage(errorImage, qApp->translate("DPCM", "Error image").toStdString() + suffixe, true, true, 0.1, false);
+            outImage(reconstructedImage, qApp->translate("DPCM", "Reconstructed image").toStdString() + suffixe);
+        }
+        return;
+    }
+    if(dialog->allImages()) {
+        // toutes les images ouvertes sont codees en parallele avec la meme loi
+        vector<const GrayscaleImage*> images;
+        vector<string> names;
+        for(map<const Image*, string>::const_iterator it = imgList.begin(); it != imgList.end(); ++it) {
+            images.push_back(Converter<GrayscaleImage>::convert(*it->first));
+            names.push_back(it->second);
+        }
+        vector<ImageDouble*> errorImages;
+        vector<Image*> reconstructedImages;
+        vector<string> reports;
+        micd.execute(images, dialog->getPrediction(), errorImages, reconstructedImages, reports, dialog->getQ());
+        for(size_t i = 0; i < images.size(); ++i) {
+            outText(names[i] + " :\n" + reports[i]);
+            outDoubleImage(errorImages[i], qApp->translate("DPCM", "Error image").toStdString() + " - " + names[i], true, true, 0.1, false);
+            outImage(reconstructedImages[i], qApp->translate("DPCM", "Reconstructed image").toStdString() + " - " + names[i]);
+            delete images[i];
+        }
+        return;
+    }
+
     GrayscaleImage* image = Converter<GrayscaleImage>::convert(*img);
     Image *reconstructedImage;
     ImageDouble *errorImage;
     string s = micd.execute(image, dialog->getPrediction(), &errorImage, &reconstructedImage, dialog->getQ());
+    delete image;
     outText(s);
     outDoubleImage(errorImage, qApp->translate("DPCM", "Error image").toStdString(), true, true, 0.1, false);
     outImage(reconstructedImage, qApp->translate("DPCM", "Reconstructed image").toStdString());
 }
+
+void DPCMEncodingOp::losslessEncoding(const GrayscaleImage* image, const string& suffixe) {
+    const int width = image->getWidth(), height = image->getHeight();
+    const size_t size = (size_t)width * height;
+    vector<uint8_t> pixels(image->begin(), image->end());
+    vector<uint8_t> decoded(size);
+    vector<int> errors(size);
+    string s = LocoI::codage(&pixels[0], width, height, &errors[0], &decoded[0]);
+    outText(s);
+
+    ImageDouble* errorImage = new ImageDouble(width, height, 1);
+    copy(errors.begin(), errors.end(), errorImage->begin());
+    GrayscaleImage* reconstructedImage = new GrayscaleImage(width, height, &decoded[0]);
+    outDoubleImage(errorImage, qApp->translate("DPCM", "Error image").toStdString() + suffixe, true, true, 0.1, false);
+    outImage(reconstructedImage, qApp->translate("DPCM", "Reconstructed image").toStdString() + suffixe);
+}
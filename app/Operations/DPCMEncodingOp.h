@@ -21,6 +21,7 @@
 #define DPCMENCODINGOP_H
 
 #include <Operation.h>
+#include <GrayscaleImage.h>
 
 class DPCMEncodingOp : public Operation
 {
@@ -30,6 +31,10 @@ public:
     void operator()(const imagein::Image*, const std::map<const imagein::Image*, std::string>&);
 
     bool needCurrentImg() const;
+
+private:
+    /* Codage sans pertes LOCO-I de image ; suffixe est ajoute aux titres des images produites */
+    void losslessEncoding(const imagein::GrayscaleImage* image, const std::string& suffixe);
 };
 
 #endif // DPCMENCODINGOP_H
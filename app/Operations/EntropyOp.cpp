@@ -22,6 +22,7 @@
 #include "EntropyOp.h"
 
 #include "../Tools.h"
+#include "../Algorithms/HistogramScan.h"
 #include <Image.h>
 
 using namespace std;
@@ -34,12 +35,15 @@ EntropyOp::EntropyOp() : Operation(qApp->translate("Operations", "Calcul d'entro
 void EntropyOp::operator()(const imagein::Image* image, const std::map<const imagein::Image*, std::string>&) {
 
     double entropy = 0.;
+    const size_t nbPixels = (size_t)image->getWidth() * image->getHeight();
     for(unsigned int c = 0; c < image->getNbChannels(); ++c) {
-        Histogram histo = image->getHistogram(c);
-        for(int i = 0; i < 256; ++i) {
-            if(histo[i] > 0) {
-                double p = (double)histo[i] / image->getWidth() /image->getHeight();
-                entropy +=  p * log(p);                
+        // canal c des pixels entrelaces
+        HistogramScan::Result histo;
+        HistogramScan::scan(image->begin() + c, nbPixels, image->getNbChannels(), histo);
+        for(int i = histo.min; i <= histo.max; ++i) {
+            if(histo.count[i] > 0) {
+                double p = (double)histo.count[i] / nbPixels;
+                entropy +=  p * log(p);
             }
         }
     }
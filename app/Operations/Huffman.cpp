@@ -22,6 +22,9 @@
 #include <cstdio>
 #include <cmath>
 #include <algorithm>
+#include <queue>
+#include <functional>
+#include <chrono>
 
 using namespace std;
 using namespace imagein;
@@ -29,13 +32,10 @@ using namespace imagein;
 Huffman::Huffman() {
     size = 0;
     nbeff = 0;
-    ilon = NULL;
     Pi = NULL;
-    codPi = NULL;
     H = 0.0;
     nbbit = 0;
     indicePi = NULL;
-    chain = NULL;
 }
 
 Huffman::~Huffman() {
@@ -43,43 +43,25 @@ Huffman::~Huffman() {
 }
 
 void Huffman::clearMem() {
-    if( ilon != NULL ) {
-        delete ilon;
-    }
-    if( Pi != NULL ) {
-        delete Pi;
-    }
-    if( codPi != NULL ) {
-        delete codPi;
-    }
-    if( indicePi != NULL ) {
-        delete indicePi;
-    }
-    if( chain != NULL ) {
-        delete chain;
-    }
+    delete[] Pi;
+    Pi = NULL;
+    delete[] indicePi;
+    indicePi = NULL;
+    ilon.clear();
+    code.clear();
 }
 
 string Huffman::execute( const GrayscaleImage *im ) {
-    int nbpt;
-    long wcounter, hcounter;
     char buffer[255];
-    char c[255];
+    char c[MAX_LONGUEUR + 1];
     std::string returnval;
-    Image::depth_t p;
     int i;
     clearMem();
     size = im->getHeight() * im->getWidth();
-    nbpt = 0;
-    for( hcounter=0; hcounter< im->getHeight(); hcounter++ ) {
-        for( wcounter=0; wcounter< im->getWidth(); wcounter++ ) {
-            p = im->getPixel( wcounter, hcounter );
-            if( p >= 0 ) {
-                nbpt++;
-            }
-        }
-    }
-    returnval = prob_Pi( im ,nbpt);
+    // dynamique et histogramme en un seul parcours du tableau de pixels
+    HistogramScan::Result histo;
+    HistogramScan::scan( im->begin(), size, 1, histo );
+    returnval = prob_Pi( histo );
     sprintf(buffer, "\nH (theo.) = %.4f\n\n",H);
     returnval = returnval + buffer;
 
@@ -87,11 +69,13 @@ string Huffman::execute( const GrayscaleImage *im ) {
 
     for(i=0 ; i<nbeff ; i++)
     {
-        sprintf(c, "%s", chain+i*nbeff);
-        reverse (c,c+strlen(c));
-        sprintf(buffer, "%s",c);
-        returnval = returnval + buffer;
-        sprintf(buffer, "--->%2d bits      Pi[%3d] = %7.5f\n",*(ilon+i),*(indicePi+i)-1,*(Pi+i));
+        // bits du code, le premier emis a gauche
+        for(int b = 0; b < ilon[i]; b++) {
+            c[b] = ( code[i] >> (ilon[i] - 1 - b) ) & 1 ? '1' : '0';
+        }
+        c[ilon[i]] = '\0';
+        returnval = returnval + c;
+        sprintf(buffer, "--->%2d bits      Pi[%3d] = %7.5f\n",ilon[i],*(indicePi+i)-1,*(Pi+i));
         returnval = returnval + buffer;
     }
     sprintf(buffer, "\n debit(huffman) = %.4f\n",nbbit);
@@ -100,63 +84,25 @@ string Huffman::execute( const GrayscaleImage *im ) {
     return returnval;
 }
 
-string Huffman::prob_Pi(const GrayscaleImage *im, int nbpt )
+string Huffman::prob_Pi( const HistogramScan::Result& histo )
 {
-    int ind,p[256],max,min;
-    long hcounter;
-    long wcounter;
-    Image::depth_t pixel;
+    int ind;
+    const int min = histo.min, max = histo.max;
+    const double nbpt = histo.total;
 
     string returnval;
     char buffer[50];
 
-/********************************/
-/*  calcul de la dynamique de	*/
-/*  l'image : min et max 	*/
-/*				*/
-/********************************/
-
-    min = 255;
-    max = 0;
-
-    for( hcounter=0; hcounter< im->getHeight(); hcounter++ ) {
-        for( wcounter=0; wcounter< im->getWidth(); wcounter++ ) {
-            pixel = im->getPixel( wcounter, hcounter );
-            if((pixel < min) && (pixel >= 0))
-                min = pixel;
-            if(pixel > max)
-                max = pixel;
-        }
-    }
-
-    sprintf(buffer, "\n nbpt = %d\n",nbpt);
+    sprintf(buffer, "\n nbpt = %lu\n",(unsigned long)histo.total);
     returnval = returnval + buffer;
     sprintf(buffer, " min = %d\n",min);
     returnval = returnval + buffer;
     sprintf(buffer, " max = %d\n",max);
     returnval = returnval + buffer;
 
-
     Pi = new double[max-min+1];
     indicePi = new short[max-min+1];
 
-    for(ind=0 ; ind <= max-min ; ind++)
-    {
-        p[ind] = 0;
-        *(Pi+ind) = 0.0;
-    }
-
-    for( hcounter=0; hcounter< im->getHeight(); hcounter++ ) {
-        for( wcounter=0; wcounter< im->getWidth(); wcounter++ ) {
-            pixel = im->getPixel( wcounter, hcounter );
-            if( pixel >= 0 ) {
-                ind = pixel;
-                p[ind-min]++;
-            }
-        }
-    }
-
-
     /**********************************
      *  nbeff : nb effectif
      *  de luminace utile --> Pi != 0
@@ -165,11 +111,12 @@ string Huffman::prob_Pi(const GrayscaleImage *im, int nbpt )
      *
      **********************************/
     nbeff=0;
+    H = 0.0;
     for(ind=0 ; ind <= max-min ; ind++)
     {
-        if(p[ind]!=0)
+        if(histo.count[ind+min]!=0)
         {
-            *(Pi+nbeff)=(double)p[ind]/(double)nbpt;
+            *(Pi+nbeff)=(double)histo.count[ind+min]/nbpt;
             H = - (*(Pi+nbeff)) * log(*(Pi+nbeff))/log((double)2.0)+H;
             *(indicePi+nbeff) = (short)(ind+1);
             nbeff++;
@@ -181,95 +128,280 @@ string Huffman::prob_Pi(const GrayscaleImage *im, int nbpt )
 
 void Huffman::codhuffman(void)
 {
-    int i,j;
-    int indic,i0,it;
-    double rp1,rp2;
-    int i1=0,i2,*icod,iter;
-
-/* codPi tableau intermdiaire de Pi pour le calcul du code de
-    Huffman.Les valeurs de codPi sont modifies dans cette partie */
-
-    chain = new char[nbeff*nbeff];
-    codPi = new double[nbeff];
-    ilon = new int[nbeff];
-    icod = new int[nbeff*nbeff];
-    //chain=(char *)calloc((unsigned)(nbeff*nbeff),sizeof(char));
-  //codPi=(double *)calloc((unsigned)(nbeff),sizeof(double));
-  //ilon=(int *)calloc((unsigned)(nbeff),sizeof(int));
-  //icod=(int *)calloc((unsigned)(nbeff*nbeff),sizeof(int));
+    vector<double> poids(Pi, Pi + nbeff);
+    longueurs( poids, ilon );
+    codesCanoniques( ilon, code );
 
-    for(i=0 ; i<nbeff ; i++)
-        *(codPi+i) = *(Pi+i);
+    nbbit = 0.0;
+    for(int i=0 ; i<nbeff ; i++)
+        nbbit = nbbit + (double)ilon[i]*Pi[i];
+}
 
-    for(i=0 ; i<nbeff ; i++)
-    {
-        *(ilon+i) = 0;
-        for(j=0 ; j<nbeff ; j++)
-        {
-            *(icod+i*nbeff+j)= -1;
-            *(chain+i*nbeff+j) = '\0';
+void Huffman::longueurs( const vector<double>& poids, vector<int>& longueur, int longueurMax )
+{
+    const int n = poids.size();
+    longueur.assign(n, 0);
+
+    // feuilles [0, n[ puis noeuds internes dans l'ordre de leur creation ; a poids egal le plus
+    // ancien noeud sort le premier, ce qui rend l'arbre independant de l'implementation du tas
+    typedef pair<double, int> Noeud;
+    priority_queue<Noeud, vector<Noeud>, greater<Noeud> > tas;
+    vector<int> pere;
+    vector<int> feuilles;
+    for(int s = 0; s < n; s++) {
+        if( poids[s] > 0.0 ) {
+            tas.push( Noeud(poids[s], pere.size()) );
+            pere.push_back(-1);
+            feuilles.push_back(s);
         }
     }
+    const int nbFeuilles = feuilles.size();
+    if( nbFeuilles == 0 ) return;
+    if( nbFeuilles == 1 ) {
+        longueur[feuilles[0]] = 1;
+        return;
+    }
+    while( tas.size() > 1 ) {
+        Noeud a = tas.top();
+        tas.pop();
+        Noeud b = tas.top();
+        tas.pop();
+        pere[a.second] = pere[b.second] = pere.size();
+        pere.push_back(-1);
+        tas.push( Noeud(a.first + b.first, pere.size() - 1) );
+    }
 
-    /* reprage des 2 mins de Pi et marquage des indices des Pi traites
-       pour ensuite leur affecter un code */
+    // profondeurs depuis la racine (dernier noeud cree), les peres etant crees apres leurs fils
+    vector<int> profondeur(pere.size(), 0);
+    for(int k = pere.size() - 2; k >= 0; k--) {
+        profondeur[k] = profondeur[pere[k]] + 1;
+    }
 
-    for(iter=0 ; iter<nbeff-1 ; iter++)
-    {
-        rp1=1.0;
-        rp2=1.0;
-        for(i=0 ; i<nbeff ; i++)
-        {
-            if(*(codPi+i) >= 0.0)
-            {
-                if(*(codPi+i)<rp1)
-                {
-                    rp2 = rp1;
-                    i2 = i1;
-                    rp1 = *(codPi+i);
-                    i1 = i;
-                }
-                else if(*(codPi+i)<rp2)
-                {
-                    rp2 = *(codPi+i);
-                    i2 = i;
-                }
+    // limitation de la longueur : les codes trop longs sont ramenes a longueurMax puis des
+    // feuilles plus courtes sont allongees jusqu'a respecter l'inegalite de Kraft
+    vector<int> nbCodes(longueurMax + 1, 0);
+    for(int k = 0; k < nbFeuilles; k++) {
+        nbCodes[ min(profondeur[k], longueurMax) ]++;
+    }
+    uint64_t kraft = 0;
+    for(int l = 1; l <= longueurMax; l++) {
+        kraft += (uint64_t)nbCodes[l] << (longueurMax - l);
+    }
+    while( kraft > ((uint64_t)1 << longueurMax) ) {
+        nbCodes[longueurMax]--;
+        for(int l = longueurMax - 1; l > 0; l--) {
+            if( nbCodes[l] > 0 ) {
+                nbCodes[l]--;
+                nbCodes[l + 1] += 2;
+                break;
             }
         }
+        kraft--;
+    }
 
-        *(icod+iter*nbeff+i2) = 0;
-        *(icod+iter*nbeff+i1) = i2+1;
-        *(codPi+i2) = *(codPi+i1) + *(codPi+i2);
-        *(codPi+i1) = -1.0;
+    // les feuilles les plus probables recoivent les codes les plus courts
+    vector<int> ordre(nbFeuilles);
+    for(int k = 0; k < nbFeuilles; k++) ordre[k] = k;
+    stable_sort( ordre.begin(), ordre.end(), [&](int a, int b) { return profondeur[a] < profondeur[b]; } );
+    int l = 1;
+    for(int k = 0; k < nbFeuilles; k++) {
+        while( nbCodes[l] == 0 ) l++;
+        longueur[feuilles[ordre[k]]] = l;
+        nbCodes[l]--;
     }
+}
 
-    /* codage effectif (0/1) des != Pi result. sur chain */
-    nbbit = 0.0;
-    for(i=0 ; i<nbeff ; i++)
+void Huffman::codesCanoniques( const vector<int>& longueur, vector<uint32_t>& code )
+{
+    const int n = longueur.size();
+    code.assign(n, 0);
+    vector<int> ordre;
+    for(int s = 0; s < n; s++) {
+        if( longueur[s] > 0 ) ordre.push_back(s);
+    }
+    stable_sort( ordre.begin(), ordre.end(), [&](int a, int b) { return longueur[a] < longueur[b]; } );
+    uint64_t c = 0;
+    int l = ordre.empty() ? 0 : longueur[ordre[0]];
+    for(size_t k = 0; k < ordre.size(); k++) {
+        c <<= longueur[ordre[k]] - l;
+        l = longueur[ordre[k]];
+        code[ordre[k]] = (uint32_t)c;
+        c++;
+    }
+}
+
+static const int MAX_ALPHABET = 1 << 20; // nombre maximal de valeurs differentes codees par encode
+static const int BITS_TABLE_MIN = 8, BITS_TABLE_MAX = 11; // taille de la table principale du decodeur
+
+size_t Huffman::Flux::tailleOctets() const
+{
+    // min et nombre de valeurs sur 4 octets, puis une longueur par octet
+    return (nbBits + 7) / 8 + 8 + longueur.size();
+}
+
+void Huffman::encode( const int *valeurs, size_t n, Flux& flux )
+{
+    flux.min = 0;
+    flux.longueur.clear();
+    flux.mots.clear();
+    flux.nbBits = 0;
+    flux.nbSymboles = n;
+    if( n == 0 ) return;
+
+    int vmin = valeurs[0], vmax = valeurs[0];
+    for(size_t i = 1; i < n; i++) {
+        vmin = min(vmin, valeurs[i]);
+        vmax = max(vmax, valeurs[i]);
+    }
+    if( (int64_t)vmax - vmin >= MAX_ALPHABET ) {
+        throw "Error in Huffman::encode:\ntoo many different values";
+    }
+    const int nbValeurs = vmax - vmin + 1;
+    vector<uint64_t> effectif(nbValeurs, 0);
+    for(size_t i = 0; i < n; i++) {
+        effectif[valeurs[i] - vmin]++;
+    }
+    vector<double> poids(effectif.begin(), effectif.end());
+    longueurs( poids, flux.longueur );
+    vector<uint32_t> code;
+    codesCanoniques( flux.longueur, code );
+    flux.min = vmin;
+
+    // longueur et code de chaque valeur dans un seul mot ; la taille du flux est connue d'avance
+    vector<uint64_t> table(nbValeurs);
+    for(int v = 0; v < nbValeurs; v++) {
+        table[v] = ((uint64_t)flux.longueur[v] << 32) | code[v];
+        flux.nbBits += effectif[v] * flux.longueur[v];
+    }
+    // un mot de plus : le decodeur lit toujours deux mots consecutifs
+    flux.mots.assign((flux.nbBits + 63) / 64 + 1, 0);
+
+    // accumulateur de 64 bits rempli par le haut, vide mot par mot
+    uint64_t *mot = &flux.mots[0];
+    uint64_t acc = 0;
+    int libres = 64;
+    for(size_t i = 0; i < n; i++) {
+        const uint64_t e = table[valeurs[i] - vmin];
+        const int l = e >> 32;
+        const uint64_t c = (uint32_t)e;
+        if( l < libres ) {
+            libres -= l;
+            acc |= c << libres;
+        }
+        else {
+            const int reste = l - libres;
+            *mot++ = acc | (c >> reste);
+            libres = 64 - reste;
+            acc = reste > 0 ? c << libres : 0;
+        }
+    }
+    if( libres < 64 ) {
+        *mot = acc;
+    }
+}
+
+void Huffman::decode( const Flux& flux, int *valeurs )
+{
+    const size_t n = flux.nbSymboles;
+    const int nbValeurs = flux.longueur.size();
+    if( n == 0 ) return;
+
+    int lmax = 0;
+    for(int v = 0; v < nbValeurs; v++) lmax = max(lmax, flux.longueur[v]);
+    vector<uint32_t> code;
+    codesCanoniques( flux.longueur, code );
+
+    // table principale indexee par les bitsTable prochains bits : valeur << 8 | longueur du code,
+    // 0 quand le code est plus long que bitsTable
+    const int bitsTable = min(BITS_TABLE_MAX, max(BITS_TABLE_MIN, lmax));
+    vector<uint32_t> table((size_t)1 << bitsTable, 0);
+    // codes longs : premier code, nombre de codes et rang du premier de chaque longueur
+    vector<uint64_t> premier(lmax + 2, 0), nombre(lmax + 2, 0), rang(lmax + 2, 0);
+    for(int v = 0; v < nbValeurs; v++) {
+        const int l = flux.longueur[v];
+        if( l == 0 ) continue;
+        nombre[l]++;
+        if( l <= bitsTable ) {
+            const uint32_t debut = code[v] << (bitsTable - l);
+            for(uint32_t k = 0; k < (1u << (bitsTable - l)); k++) {
+                table[debut + k] = ((uint32_t)v << 8) | l;
+            }
+        }
+    }
+    for(int l = 1; l <= lmax; l++) {
+        premier[l] = (premier[l - 1] + nombre[l - 1]) << 1;
+        rang[l] = rang[l - 1] + nombre[l - 1];
+    }
+    vector<int> parLongueur(rang[lmax] + nombre[lmax]);
     {
-        indic = 0;
-        i0 = i;
-        for(iter=0 ; iter<nbeff-1 ; iter++)
-        {
-            it = *(icod+iter*nbeff+i0);
-            if(it>=0)
-            {
-                *(ilon+i) = *(ilon+i) +1;
-                if(it==0)
-                {
-                    *(chain+i*nbeff+indic) = '0';
-                    indic++;
-                }
-                else
-                {
-                    *(chain+i*nbeff+indic) = '1';
-                    indic++;
-                    i0 = it - 1;
+        vector<uint64_t> suivant(rang);
+        for(int v = 0; v < nbValeurs; v++) {
+            if( flux.longueur[v] > 0 ) parLongueur[suivant[flux.longueur[v]]++] = v;
+        }
+    }
+
+    const uint64_t *mots = &flux.mots[0];
+    const int vmin = flux.min;
+    uint64_t pos = 0;
+    for(size_t i = 0; i < n; i++) {
+        // les 64 bits a partir de pos (decalage en deux fois pour d = 0)
+        const uint64_t *m = mots + (pos >> 6);
+        const int d = pos & 63;
+        const uint64_t fenetre = (m[0] << d) | ((m[1] >> 1) >> (63 - d));
+        const uint32_t e = table[fenetre >> (64 - bitsTable)];
+        if( e != 0 ) {
+            valeurs[i] = (int)(e >> 8) + vmin;
+            pos += e & 0xFF;
+        }
+        else {
+            for(int l = bitsTable + 1; l <= lmax; l++) {
+                const uint64_t c = (fenetre >> (64 - l)) - premier[l];
+                if( c < nombre[l] ) {
+                    valeurs[i] = parLongueur[rang[l] + c] + vmin;
+                    pos += l;
+                    break;
                 }
             }
         }
-        nbbit = nbbit + (double)(*(ilon+i))*(*(Pi+i));
+    }
+}
 
+string Huffman::codage( const int *valeurs, size_t n )
+{
+    string returnval;
+    char buffer[255];
+    Flux flux;
+    vector<int> decodees(n);
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    encode( valeurs, n, flux );
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+    decode( flux, decodees.empty() ? NULL : &decodees[0] );
+    chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+    const bool exacte = equal( decodees.begin(), decodees.end(), valeurs );
+
+    // entropie d'ordre 0 des valeurs, pour comparaison
+    double h = 0.;
+    vector<size_t> effectif(flux.longueur.size(), 0);
+    for(size_t i = 0; i < n; i++) effectif[valeurs[i] - flux.min]++;
+    for(size_t v = 0; v < effectif.size(); v++) {
+        if( effectif[v] > 0 ) {
+            const double p = (double)effectif[v] / n;
+            h -= p * log(p) / log(2.0);
+        }
     }
-    delete icod;
+
+    const double dureeCodage = max(chrono::duration<double>(t1 - t0).count(), 1e-9);
+    const double dureeDecodage = max(chrono::duration<double>(t2 - t1).count(), 1e-9);
+    sprintf(buffer, "\n Codage effectif : %lu valeurs dans [%d, %d]\n", (unsigned long)n, flux.min, flux.min + (int)flux.longueur.size() - 1);
+    returnval = returnval + buffer;
+    sprintf(buffer, " taille compressee = %lu octets (dont %lu pour la table des longueurs)\n", (unsigned long)flux.tailleOctets(), (unsigned long)(flux.longueur.size() + 8));
+    returnval = returnval + buffer;
+    sprintf(buffer, " debit reel = %.4f bits/pixel (entropie %.4f)\n", n ? 8.0 * flux.tailleOctets() / n : 0.0, h);
+    returnval = returnval + buffer;
+    sprintf(buffer, " codage : %.1f Mpixels/s, decodage : %.1f Mpixels/s\n", n / dureeCodage * 1e-6, n / dureeDecodage * 1e-6);
+    returnval = returnval + buffer;
+    sprintf(buffer, " reconstruction exacte : %s\n", exacte ? "oui" : "NON");
+    returnval = returnval + buffer;
+    return returnval;
 }
@@ -21,6 +21,9 @@
 #define HUFFMAN_H
 
 #include <GrayscaleImage.h>
+#include <vector>
+#include <stdint.h>
+#include "../Algorithms/HistogramScan.h"
 
 class Huffman
 {
@@ -28,13 +31,38 @@ class Huffman
     Huffman();
     virtual ~Huffman();
     std::string execute( const imagein::GrayscaleImage *im );
+
+    static const int MAX_LONGUEUR = 32; // les codes tiennent dans un uint32_t
+    /* Longueurs des codes de Huffman des symboles de poids (effectif ou probabilite) poids[s],
+     * limitees a longueurMax bits ; 0 pour un symbole de poids nul */
+    static void longueurs( const std::vector<double>& poids, std::vector<int>& longueur, int longueurMax = MAX_LONGUEUR );
+    /* Code canonique : les symboles sont numerotes par longueur puis par indice croissants,
+     * le code du symbole s est forme des longueur[s] bits de poids faible de code[s] */
+    static void codesCanoniques( const std::vector<int>& longueur, std::vector<uint32_t>& code );
+
+    /* Flux produit par encode : valeurs de [min, min + longueur.size()[ codees par le code canonique
+     * de longueurs longueur, les bits etant ranges a partir du bit de poids fort du premier mot */
+    struct Flux {
+        int min;
+        std::vector<int> longueur;
+        std::vector<uint64_t> mots;
+        uint64_t nbBits;
+        size_t nbSymboles;
+        size_t tailleOctets() const; // donnees et table des longueurs
+    };
+    static void encode( const int *valeurs, size_t n, Flux& flux );
+    static void decode( const Flux& flux, int *valeurs );
+    /* Codage effectif des valeurs : taille compressee, debits de codage et de decodage,
+     * verification de la reconstruction */
+    static std::string codage( const int *valeurs, size_t n );
   private:
     void clearMem();
-    int size,nbeff,*ilon;
-    double *Pi,*codPi,H,nbbit;
+    int size,nbeff;
+    std::vector<int> ilon;
+    std::vector<uint32_t> code;
+    double *Pi,H,nbbit;
     short *indicePi;
-    char *chain;
-    std::string prob_Pi(const imagein::GrayscaleImage *im, int nbpt);
+    std::string prob_Pi( const HistogramScan::Result& histo );
     void codhuffman(void);
 };
 #endif // HUFFMAN_H
@@ -23,10 +23,16 @@
 #include <GrayscaleImage.h>
 #include <string>
 #include <Converter.h>
+#include <Widgets/ImageWidgets/StandardImageWindow.h>
+#include <Widgets/ImageWidgets/DoubleImageWindow.h>
+#include <QMessageBox>
+#include <cmath>
+#include <climits>
 using namespace std;
 using namespace imagein;
+using namespace genericinterface;
 
-HuffmanOp::HuffmanOp() : Operation(qApp->translate("Operations", "Huffman").toStdString())
+HuffmanOp::HuffmanOp() : GenericOperation(qApp->translate("Operations", "Huffman").toStdString())
 {
 }
 
@@ -34,10 +40,52 @@ bool HuffmanOp::needCurrentImg() const {
     return true;
 }
 
-void HuffmanOp::operator()(const imagein::Image* image, const std::map<const imagein::Image*, std::string>&) {
-    Huffman huff;
-    GrayscaleImage* grayImg = Converter<GrayscaleImage>::convert(*image);
-    string res = huff.execute(grayImg);
-    outText(res);
-    delete grayImg;
+bool HuffmanOp::isValidImgWnd(const genericinterface::ImageWindow* imgWnd) const {
+    return imgWnd != NULL;
+}
+
+void HuffmanOp::operator()(const ImageWindow* currentWnd, const vector<const ImageWindow*>&) {
+    vector<int> valeurs;
+    string res;
+    if(currentWnd->isStandard()) {
+        const Image* image = static_cast<const StandardImageWindow*>(currentWnd)->getImage();
+        GrayscaleImage* grayImg = Converter<GrayscaleImage>::convert(*image);
+        valeurs.assign(grayImg->begin(), grayImg->end());
+        if(!valeurs.empty()) {
+            try {
+                Huffman huff;
+                res = huff.execute(grayImg);
+            }
+            catch(const char* e) {
+                delete grayImg;
+                QMessageBox::critical(NULL, "Error", QString(e));
+                return;
+            }
+        }
+        delete grayImg;
+    }
+    else if(currentWnd->isDouble()) {
+        // images d'erreur de prediction (DPCM) : les valeurs sont arrondies a l'entier le plus proche
+        const Image_t<double>* image = static_cast<const DoubleImageWindow*>(currentWnd)->getImage();
+        valeurs.resize(image->end() - image->begin());
+        for(size_t i = 0; i < valeurs.size(); ++i) {
+            const double v = image->begin()[i];
+            // lround n'est pas defini pour NaN ni hors des int (le test est faux pour NaN)
+            if(!(v > INT_MIN - 0.5 && v < INT_MAX + 0.5)) {
+                QMessageBox::critical(NULL, "Error", "Error in HuffmanOp:\nvalue out of the integer range");
+                return;
+            }
+            valeurs[i] = (int)lround(v);
+        }
+    }
+    if(valeurs.empty()) return;
+
+    try {
+        res += Huffman::codage(&valeurs[0], valeurs.size());
+        outText(res);
+    }
+    catch(const char* e) {
+        QMessageBox::critical(NULL, "Error", QString(e));
+        return;
+    }
 }
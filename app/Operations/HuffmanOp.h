@@ -22,13 +22,14 @@
 
 #include <Operation.h>
 
-class HuffmanOp : public Operation
+class HuffmanOp : public GenericOperation
 {
 public:
     HuffmanOp();
-    void operator()(const imagein::Image*, const std::map<const imagein::Image*, std::string>&);
+    void operator()(const genericinterface::ImageWindow* currentWnd, const std::vector<const genericinterface::ImageWindow*>&);
 
     bool needCurrentImg() const;
+    virtual bool isValidImgWnd(const genericinterface::ImageWindow* imgWnd) const;
 };
 
 #endif // HUFFMANOP_H
@@ -24,11 +24,14 @@
 #include "InversePyramidDialog.h"
 #include <GrayscaleImage.h>
 #include <Converter.h>
+#include <Widgets/ImageWidgets/StandardImageWindow.h>
+#include <Widgets/ImageWidgets/DoubleImageWindow.h>
 
 using namespace std;
 using namespace imagein;
+using namespace genericinterface;
 
-InversePyramidOp::InversePyramidOp() : Operation(qApp->translate("Operations", "Pyramidal reconstruction").toStdString())
+InversePyramidOp::InversePyramidOp() : GenericOperation(qApp->translate("Operations", "Pyramidal reconstruction").toStdString())
 {
 }
 
@@ -36,31 +39,36 @@ bool InversePyramidOp::needCurrentImg() const {
     return true;
 }
 
-void InversePyramidOp::operator()(const imagein::Image* img, const std::map<const imagein::Image*, std::string>&) {
-    if(2 * img->getWidth() != img->getHeight()) {
-        QMessageBox::warning(NULL, qApp->translate("Operations", "The operation can't be applied on this image"),
-                             qApp->translate("Operations", "The image width must be twice the image height."));
-        return;
-    }
-    if(!Pyramid::isPowerOf2(img->getWidth())) {
-        QMessageBox::warning(NULL, qApp->translate("Operations", "The operation can't be applied on this image"),
-                             qApp->translate("Operations", "The image dimensions must be power of 2."));
-        return;
-    }
+bool InversePyramidOp::isValidImgWnd(const genericinterface::ImageWindow* imgWnd) const {
+    return imgWnd != NULL;
+}
 
+void InversePyramidOp::operator()(const ImageWindow* currentWnd, const vector<const ImageWindow*>&) {
     InversePyramidDialog* dialog = new InversePyramidDialog(QApplication::activeWindow());
     QDialog::DialogCode code = static_cast<QDialog::DialogCode>(dialog->exec());
 
     if(code!=QDialog::Accepted) return;
 
-    GrayscaleImage* image = Converter<GrayscaleImage>::convert(*img);
     Image* resImg = NULL;
     string s;
     Pyramid::filtre filter = dialog->getFilter();
+    GrayscaleImage* grayImage = NULL;
     try {
-        resImg = Pyramid::rebuild_interface(image, dialog->getNbStep(), dialog->getStep(), filter);
+        if(currentWnd->isDouble()) {
+            // pyramide Laplacienne exacte produite par PyramidOp
+            const ImageDouble* image = static_cast<const DoubleImageWindow*>(currentWnd)->getImage();
+            resImg = Pyramid::rebuild_interface(image, dialog->getNbStep(), dialog->getStep(), filter);
+        }
+        else if(currentWnd->isStandard()) {
+            // ancien format 8 bits
+            const Image* img = static_cast<const StandardImageWindow*>(currentWnd)->getImage();
+            grayImage = Converter<GrayscaleImage>::convert(*img);
+            resImg = Pyramid::rebuild_interface(grayImage, dialog->getNbStep(), dialog->getStep(), filter);
+            delete grayImage;
+        }
     }
     catch(const char*e) {
+        delete grayImage;
         QMessageBox::critical(NULL, "Error", QString(e));
         return;
     }
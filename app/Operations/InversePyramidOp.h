@@ -22,14 +22,15 @@
 
 #include <Operation.h>
 
-class InversePyramidOp : public Operation
+class InversePyramidOp : public GenericOperation
 {
 public:
     InversePyramidOp();
 
-    void operator()(const imagein::Image*, const std::map<const imagein::Image*, std::string>&);
+    void operator()(const genericinterface::ImageWindow* currentWnd, const std::vector<const genericinterface::ImageWindow*>&);
 
     bool needCurrentImg() const;
+    virtual bool isValidImgWnd(const genericinterface::ImageWindow* imgWnd) const;
 };
 
 #endif // INVERSEPYRAMID_H
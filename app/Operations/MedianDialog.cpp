@@ -20,6 +20,10 @@ unsigned int MedianDialog::getSize() const {
     return ui->spinBox->value();
 }
 
+int MedianDialog::getPercentile() const {
+    return ui->percentileBox->value();
+}
+
 MedianDialog::~MedianDialog()
 {
     delete ui;
@@ -18,6 +18,7 @@ public:
     bool cross() const;
     bool square() const;
     unsigned int getSize() const;
+    int getPercentile() const;
 
 private:
     Ui::MedianDialog *ui;
@@ -3,14 +3,15 @@
 
 #include "Operation.h"
 
-class MedianOp : public Operation
+class MedianOp : public GenericOperation
 {
 public:
     MedianOp();
 
-    void operator()(const imagein::Image*, const std::map<const imagein::Image*, std::string>&);
+    void operator()(const genericinterface::ImageWindow* currentWnd, const std::vector<const genericinterface::ImageWindow*>&);
 
     bool needCurrentImg() const;
+    virtual bool isValidImgWnd(const genericinterface::ImageWindow* imgWnd) const;
 };
 
 #endif // MEDIANOP_H
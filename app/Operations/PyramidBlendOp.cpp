@@ -0,0 +1,95 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "PyramidBlendOp.h"
+
+#include <QApplication>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QComboBox>
+#include <QSpinBox>
+#include <QMessageBox>
+#include <Image.h>
+
+#include <Widgets/ImageListBox.h>
+#include "../Algorithms/Pyramid.h"
+
+using namespace std;
+using namespace imagein;
+
+PyramidBlendOp::PyramidBlendOp() : Operation(qApp->translate("Operations", "Multiband blending").toStdString())
+{
+}
+
+bool PyramidBlendOp::needCurrentImg() const {
+    return true;
+}
+
+void PyramidBlendOp::operator()(const imagein::Image* image, const std::map<const imagein::Image*, std::string>& imgList) {
+
+    QDialog* dialog = new QDialog();
+    dialog->setWindowTitle(qApp->translate("Operations", "Multiband blending"));
+    dialog->setMinimumWidth(180);
+    QFormLayout* layout = new QFormLayout();
+    dialog->setLayout(layout);
+
+    QString currentImgName = QString(imgList.find(image)->second.c_str());
+
+    ImageListBox* imageBox = new ImageListBox(dialog, image, imgList);
+    ImageListBox* maskBox = new ImageListBox(dialog, image, imgList);
+    QComboBox* filterBox = new QComboBox(dialog);
+    filterBox->addItem(qApp->translate("Operations", "triangular"), QString("triangulaire"));
+    filterBox->addItem(qApp->translate("Operations", "gaussian"), QString("gaussien"));
+    filterBox->addItem(qApp->translate("Operations", "trimodal"), QString("trimodal"));
+    filterBox->addItem(qApp->translate("Operations", "rectangular"), QString("rectangulaire"));
+    filterBox->addItem(qApp->translate("Operations", "qmf"), QString("qmf"));
+    filterBox->setCurrentIndex(1);
+    QSpinBox* stepBox = new QSpinBox(dialog);
+    stepBox->setRange(1, 16);
+    stepBox->setValue(6);
+    layout->insertRow(0, qApp->translate("Operations", "Blend %1 with : ").arg(currentImgName), imageBox);
+    layout->insertRow(1, qApp->translate("Operations", "Mask (white : %1) : ").arg(currentImgName), maskBox);
+    layout->insertRow(2, qApp->translate("Operations", "Filter : "), filterBox);
+    layout->insertRow(3, qApp->translate("Operations", "Number of steps : "), stepBox);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok|QDialogButtonBox::Cancel, Qt::Horizontal, dialog);
+    layout->insertRow(4, buttonBox);
+    QObject::connect(buttonBox, SIGNAL(accepted()), dialog, SLOT(accept()));
+    QObject::connect(buttonBox, SIGNAL(rejected()), dialog, SLOT(reject()));
+
+    QDialog::DialogCode code = static_cast<QDialog::DialogCode>(dialog->exec());
+
+    if(code!=QDialog::Accepted) {
+        return;
+    }
+
+    Pyramid::Filters filters;
+    Pyramid::filtre filtre;
+    filters.getFromName(filterBox->itemData(filterBox->currentIndex()).toString().toStdString().c_str(), filtre);
+
+    Image* resImg = NULL;
+    try {
+        resImg = Pyramid::blend(image, imageBox->currentImage(), maskBox->currentImage(), stepBox->value(), filtre);
+    }
+    catch(const char*e) {
+        QMessageBox::critical(NULL, "Error", QString(e));
+        return;
+    }
+    outImage(resImg, qApp->translate("Operations", "Blended").toStdString());
+}
@@ -39,48 +39,60 @@ bool PyramidOp::needCurrentImg() const {
 
 void PyramidOp::operator()(const imagein::Image* img, const std::map<const imagein::Image*, std::string>&) {
 
-    if(img->getWidth() != img->getHeight()) {
-        QMessageBox::warning(NULL, qApp->translate("Operations", "The operation can't be applied on this image"),
-                             qApp->translate("Operations", "The image width must equal the image height."));
-        return;
-    }
-    if(!Pyramid::isPowerOf2(img->getWidth())) {
-        QMessageBox::warning(NULL, qApp->translate("Operations", "The operation can't be applied on this image"),
-                             qApp->translate("Operations", "The image dimensions must be power of 2."));
-        return;
-    }
-
     PyramidDialog* dialog = new PyramidDialog(QApplication::activeWindow());
     QDialog::DialogCode code = static_cast<QDialog::DialogCode>(dialog->exec());
 
     if(code!=QDialog::Accepted) return;
 
+    map<const Image*, Caches::iterator>::iterator it = _index.find(img);
+    if(it != _index.end()) {
+        _caches.splice(_caches.begin(), _caches, it->second);
+    }
+    else {
+        if(_caches.size() >= NB_CACHES) {
+            _index.erase(_caches.back().first);
+            _caches.pop_back();
+        }
+        _caches.push_front(make_pair(img, Pyramid::Cache()));
+        _index[img] = _caches.begin();
+    }
+    Pyramid::Cache& cache = _caches.front().second;
+
     GrayscaleImage* image = Converter<GrayscaleImage>::convert(*img);
     Image* resImg = NULL;
+    ImageDouble* lapImg = NULL;
     string s;
     Pyramid::filtre filtre = dialog->getFilter();
     try {
         if(dialog->onlyOneStep()) {
             if(dialog->isGaussian()) {
-                resImg = Pyramid::n_pyram_g(image, dialog->onlyStep(), filtre);
+                resImg = cache.n_pyram_g(image, dialog->onlyStep(), filtre);
             }
             else {
-                resImg = Pyramid::n_pyram_l(image, dialog->onlyStep(), filtre);
+                lapImg = cache.n_pyram_l(image, dialog->onlyStep(), filtre);
             }
         }
         else {
             if(dialog->isGaussian()) {
-                resImg = Pyramid::pyram_g(image, dialog->getNbStep(), filtre, s);
+                resImg = cache.pyram_g(image, dialog->getNbStep(), filtre, s);
             }
             else {
-                resImg = Pyramid::pyram_l(image, dialog->getNbStep(), filtre, s);
+                lapImg = cache.pyram_l(image, dialog->getNbStep(), filtre, s);
             }
         }
     }
     catch(const char*e) {
+        delete image;
         QMessageBox::critical(NULL, "Error", QString(e));
         return;
     }
-    outImage(resImg, "Pyramid");
+    delete image;
+    if(resImg != NULL) {
+        outImage(resImg, "Pyramid");
+    }
+    else {
+        // differences signees, conservees telles quelles pour la reconstruction
+        outDoubleImage(lapImg, "Pyramid", true);
+    }
     outText(s);
 }
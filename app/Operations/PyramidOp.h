@@ -21,6 +21,9 @@
 #define PYRAMIDOP_H
 
 #include <Operation.h>
+#include <list>
+#include <map>
+#include "../Algorithms/Pyramid.h"
 
 class PyramidOp : public Operation
 {
@@ -30,6 +33,15 @@ public:
     void operator()(const imagein::Image*, const std::map<const imagein::Image*, std::string>&);
 
     bool needCurrentImg() const;
+
+private:
+    static const size_t NB_CACHES = 4;
+    // pyramides des dernieres images traitees, de la plus recente a la plus ancienne, pour parcourir
+    // les etages sans tout recalculer ; chaque Cache verifie dimensions et somme de controle de l'image
+    // a chaque acces, une nouvelle image allouee a l'adresse d'une image fermee ne reprend donc pas ses etages
+    typedef std::list<std::pair<const imagein::Image*, Pyramid::Cache> > Caches;
+    Caches _caches;
+    std::map<const imagein::Image*, Caches::iterator> _index;
 };
 
 #endif // PYRAMIDOP_H
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "RangeCoderOp.h"
+#include "Huffman.h"
+#include "../Algorithms/RangeCoder.h"
+#include "../Tools.h"
+#include <GrayscaleImage.h>
+#include <string>
+#include <Converter.h>
+#include <Widgets/ImageWidgets/StandardImageWindow.h>
+#include <Widgets/ImageWidgets/DoubleImageWindow.h>
+#include <QMessageBox>
+#include <cmath>
+#include <climits>
+using namespace std;
+using namespace imagein;
+using namespace genericinterface;
+
+RangeCoderOp::RangeCoderOp() : GenericOperation(qApp->translate("Operations", "Range coding").toStdString())
+{
+}
+
+bool RangeCoderOp::needCurrentImg() const {
+    return true;
+}
+
+bool RangeCoderOp::isValidImgWnd(const genericinterface::ImageWindow* imgWnd) const {
+    return imgWnd != NULL;
+}
+
+void RangeCoderOp::operator()(const ImageWindow* currentWnd, const vector<const ImageWindow*>&) {
+    vector<int> valeurs;
+    int largeur = 0;
+    if(currentWnd->isStandard()) {
+        const Image* image = static_cast<const StandardImageWindow*>(currentWnd)->getImage();
+        GrayscaleImage* grayImg = Converter<GrayscaleImage>::convert(*image);
+        valeurs.assign(grayImg->begin(), grayImg->end());
+        largeur = grayImg->getWidth();
+        delete grayImg;
+    }
+    else if(currentWnd->isDouble()) {
+        // erreurs de prediction (DPCM), coefficients (DCT) : valeurs arrondies a l'entier le plus proche,
+        // canal apres canal pour que le voisin de gauche soit dans le meme canal
+        const Image_t<double>* image = static_cast<const DoubleImageWindow*>(currentWnd)->getImage();
+        const size_t nbPixels = (size_t)image->getWidth() * image->getHeight();
+        const unsigned nbCanaux = image->getNbChannels();
+        valeurs.resize(nbPixels * nbCanaux);
+        for(unsigned c = 0; c < nbCanaux; ++c) {
+            for(size_t i = 0; i < nbPixels; ++i) {
+                const double v = image->begin()[i * nbCanaux + c];
+                // lround n'est pas defini pour NaN ni hors des int (le test est faux pour NaN)
+                if(!(v > INT_MIN - 0.5 && v < INT_MAX + 0.5)) {
+                    QMessageBox::critical(NULL, "Error", "Error in RangeCoderOp:\nvalue out of the integer range");
+                    return;
+                }
+                valeurs[c * nbPixels + i] = (int)lround(v);
+            }
+        }
+        largeur = image->getWidth();
+    }
+    if(valeurs.empty()) return;
+
+    try {
+        string res = Huffman::codage(&valeurs[0], valeurs.size());
+        res += RangeCoder::codage(&valeurs[0], valeurs.size(), largeur, false);
+        res += RangeCoder::codage(&valeurs[0], valeurs.size(), largeur, true);
+        outText(res);
+    }
+    catch(const char* e) {
+        QMessageBox::critical(NULL, "Error", QString(e));
+        return;
+    }
+}
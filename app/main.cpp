@@ -58,6 +58,7 @@
 #include "Operations/QuantificationOp.h"
 #include "Operations/EntropyOp.h"
 #include "Operations/HuffmanOp.h"
+#include "Operations/RangeCoderOp.h"
 #include "Operations/RejectionRingOp.h"
 #include "Operations/DPCMEncodingOp.h"
 #include "Operations/HadamardOp.h"
@@ -66,6 +67,7 @@
 #include "Operations/InverseHoughOp.h"
 #include "Operations/PyramidOp.h"
 #include "Operations/InversePyramidOp.h"
+#include "Operations/PyramidBlendOp.h"
 #include "Operations/ClassAnalysisOp.h"
 #include "Operations/ClassResultOp.h"
 #include "Operations/SeparatorOp.h"
@@ -155,6 +157,7 @@ int main(int argc, char** argv)
 
     BuiltinOpSet* encode = new BuiltinOpSet(qApp->translate("", "&Encoding").toStdString());
     encode->addOperation(new HuffmanOp());
+    encode->addOperation(new RangeCoderOp());
     encode->addOperation(new DPCMEncodingOp());
 
     BuiltinOpSet* morpho = new BuiltinOpSet("&Morpho. math.");
@@ -174,6 +177,7 @@ int main(int argc, char** argv)
     analyse->addOperation(new ZeroCrossingOp());
     analyse->addOperation(new PyramidOp());
     analyse->addOperation(new InversePyramidOp());
+    analyse->addOperation(new PyramidBlendOp());
     analyse->addOperation(new ClassAnalysisOp());
     analyse->addOperation(new ClassResultOp());
     analyse->addOperation(new PseudoColorOp());
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Minimal fork/join helpers used by the algorithms to process independent
+ * parts of an image (row bands, channels, images...) on every core.
+ */
+namespace Parallel
+{
+    inline int nbThreads() {
+        const int n = std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+    }
+
+    /**
+     * True while the current thread runs a band of forBands. Nested calls
+     * then process their whole range inline, so that parallel algorithms
+     * called from a parallel loop do not start nbThreads() threads each.
+     */
+    inline bool& inParallel() {
+        static thread_local bool inside = false;
+        return inside;
+    }
+
+    /**
+     * Splits [begin, end[ in contiguous bands of at least grain elements and
+     * calls f(bandBegin, bandEnd) for each band, one band per thread.
+     * The calling thread processes the first band. f must not throw.
+     */
+    template<typename F>
+    void forBands(int begin, int end, F f, int grain = 1) {
+        const int n = end - begin;
+        if(n <= 0) return;
+        const int nbBands = inParallel() ? 1 : std::max(1, std::min(nbThreads(), n / std::max(1, grain)));
+        if(nbBands == 1) {
+            f(begin, end);
+            return;
+        }
+        auto band = [f](int b, int e) mutable {
+            inParallel() = true;
+            f(b, e);
+            inParallel() = false;
+        };
+        std::vector<std::thread> threads;
+        for(int b = 1; b < nbBands; ++b) {
+            threads.push_back(std::thread(band, begin + n * b / nbBands, begin + n * (b + 1) / nbBands));
+        }
+        band(begin, begin + n / nbBands);
+        for(std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it) {
+            it->join();
+        }
+    }
+
+    /**
+     * Calls f(i) for every i in [begin, end[, the indices being shared
+     * between the threads.
+     */
+    template<typename F>
+    void forEach(int begin, int end, F f) {
+        forBands(begin, end, [&f](int b, int e) {
+            for(int i = b; i < e; ++i) f(i);
+        });
+    }
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,328 @@
+/*
+ * Copyright 2011-2012 INSA Rennes
+ *
+ * This file is part of ImageINSA.
+ *
+ * ImageINSA is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ImageINSA is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ImageINSA.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RANKFILTER_H
+#define RANKFILTER_H
+
+#include <Image.h>
+#include "Parallel.h"
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+/**
+ * Rank (order statistic) filtering : min, max, median or any percentile
+ * of the pixels covered by a mask centered on each pixel.
+ *
+ * The window is slid along each row : only the pixels entering and leaving
+ * the mask are updated, the rank is then read from the window structure.
+ * 8 bits images use a two level histogram. Other depths (double images) are
+ * first replaced by the rank of each value among the values of the rows
+ * involved, the window is then an indexable histogram (Fenwick tree) of these
+ * ranks, so the result is exact and every update costs O(log n).
+ * As in the original median filter, the mask is clipped on the image borders
+ * and the rank is taken among the pixels actually covered.
+ * The image is split in row bands filtered in parallel, each band having its
+ * own window and writing directly in the rows of the result.
+ */
+namespace RankFilter
+{
+    struct Offset {
+        Offset(int dx_, int dy_) : dx(dx_), dy(dy_) {}
+        int dx, dy;
+    };
+
+    /**
+     * Support of the filter, as a list of offsets relative to its center.
+     */
+    class Mask
+    {
+    public:
+        /* grid is a row-major width x height array, (cx, cy) is the center of the mask */
+        Mask(const std::vector<bool>& grid, int width, int height, int cx, int cy);
+
+        static Mask square(int side);
+        static Mask cross(int side);
+
+        inline int size() const { return _offsets.size(); }
+        /* vertical extent of the mask : rows y + top() to y + bottom() are involved */
+        inline int top() const { return _top; }
+        inline int bottom() const { return _bottom; }
+        inline const std::vector<Offset>& offsets() const { return _offsets; }
+        /* offsets leaving the window when it moves from x to x+1 */
+        inline const std::vector<Offset>& leaving() const { return _leaving; }
+        /* offsets entering the window when it moves from x to x+1, relative to x+1 */
+        inline const std::vector<Offset>& entering() const { return _entering; }
+
+    private:
+        std::vector<Offset> _offsets, _leaving, _entering;
+        int _top, _bottom;
+    };
+
+    /* index of the percentile (in [0, 100]) in a sorted window of n values */
+    inline int rankOf(double percentile, int n) {
+        if(percentile < 0.) percentile = 0.;
+        if(percentile > 100.) percentile = 100.;
+        return static_cast<int>(percentile * (n - 1) / 100. + 0.5);
+    }
+
+    /**
+     * Sliding histogram for 8 bits values, with 16 coarse bins of 16 levels
+     * so a rank is found in at most 32 steps.
+     */
+    class HistogramWindow
+    {
+    public:
+        HistogramWindow() { clear(); }
+        inline void clear() {
+            std::fill(_fine, _fine + 256, 0);
+            std::fill(_coarse, _coarse + 16, 0);
+            _count = 0;
+        }
+        inline void add(uint8_t v) { ++_fine[v]; ++_coarse[v >> 4]; ++_count; }
+        inline void remove(uint8_t v) { --_fine[v]; --_coarse[v >> 4]; --_count; }
+        inline int count() const { return _count; }
+        inline uint8_t at(int k) const {
+            int c = 0;
+            while(k >= _coarse[c]) {
+                k -= _coarse[c];
+                ++c;
+            }
+            int v = c << 4;
+            while(k >= _fine[v]) {
+                k -= _fine[v];
+                ++v;
+            }
+            return static_cast<uint8_t>(v);
+        }
+    private:
+        int _fine[256];
+        int _coarse[16];
+        int _count;
+    };
+
+    /**
+     * Indexable histogram of values in [0, n[ (Fenwick tree) : insertion,
+     * removal and search of the k-th value are all in O(log n).
+     */
+    class IndexedWindow
+    {
+    public:
+        explicit IndexedWindow(int n) : _tree(n + 1, 0), _count(0) {
+            for(_top = 1; _top * 2 <= n; _top *= 2);
+        }
+        inline void add(uint32_t v) {
+            for(int i = v + 1; i < static_cast<int>(_tree.size()); i += i & -i) ++_tree[i];
+            ++_count;
+        }
+        inline void remove(uint32_t v) {
+            for(int i = v + 1; i < static_cast<int>(_tree.size()); i += i & -i) --_tree[i];
+            --_count;
+        }
+        inline int count() const { return _count; }
+        inline uint32_t at(int k) const {
+            int pos = 0;
+            for(int step = _top; step > 0; step >>= 1) {
+                if(pos + step < static_cast<int>(_tree.size()) && _tree[pos + step] <= k) {
+                    pos += step;
+                    k -= _tree[pos];
+                }
+            }
+            return pos;
+        }
+    private:
+        std::vector<int> _tree;
+        int _count, _top;
+    };
+
+    /**
+     * Slides the window along the rows [rowBegin, rowEnd[.
+     * Pixel (x, y) of the input is in[((y - inRow) * width + x) * stride],
+     * the output is written the same way from outRow.
+     */
+    template<typename T, typename W>
+    void slide(const T* in, int inRow, T* out, int outRow, int width, int height, int stride,
+               const Mask& mask, double percentile, int rowBegin, int rowEnd, W& window);
+
+    /**
+     * Filters the rows [rowBegin, rowEnd[ of the channel c of src into dst.
+     */
+    template<typename D>
+    void filterRows(const imagein::Image_t<D>* src, imagein::Image_t<D>* dst, unsigned int c,
+                    const Mask& mask, double percentile, int rowBegin, int rowEnd);
+
+    /**
+     * Filters every channel of src into dst, which must have the same dimensions.
+     * Row bands are processed in parallel.
+     */
+    template<typename D>
+    void filter(const imagein::Image_t<D>* src, imagein::Image_t<D>* dst, const Mask& mask, double percentile);
+
+    template<typename D>
+    imagein::Image_t<D>* filter(const imagein::Image_t<D>* src, const Mask& mask, double percentile);
+}
+
+inline RankFilter::Mask::Mask(const std::vector<bool>& grid, int width, int height, int cx, int cy)
+    : _top(0), _bottom(0) {
+    for(int j = 0; j < height; ++j) {
+        for(int i = 0; i < width; ++i) {
+            if(!grid[j * width + i]) continue;
+            const Offset o(i - cx, j - cy);
+            _offsets.push_back(o);
+            _top = std::min(_top, o.dy);
+            _bottom = std::max(_bottom, o.dy);
+            if(i == 0 || !grid[j * width + i - 1]) _leaving.push_back(o);
+            if(i == width - 1 || !grid[j * width + i + 1]) _entering.push_back(o);
+        }
+    }
+}
+
+inline RankFilter::Mask RankFilter::Mask::square(int side) {
+    const int half = side / 2;
+    const int width = 2 * half + 1;
+    return Mask(std::vector<bool>(width * width, true), width, width, half, half);
+}
+
+inline RankFilter::Mask RankFilter::Mask::cross(int side) {
+    const int half = side / 2;
+    const int width = 2 * half + 1;
+    std::vector<bool> grid(width * width, false);
+    for(int k = 0; k < width; ++k) {
+        grid[half * width + k] = true;
+        grid[k * width + half] = true;
+    }
+    return Mask(grid, width, width, half, half);
+}
+
+template<typename T, typename W>
+void RankFilter::slide(const T* in, int inRow, T* out, int outRow, int width, int height, int stride,
+                       const Mask& mask, double percentile, int rowBegin, int rowEnd, W& window) {
+    const std::vector<Offset>& offsets = mask.offsets();
+    const std::vector<Offset>& leaving = mask.leaving();
+    const std::vector<Offset>& entering = mask.entering();
+    std::vector<Offset>::const_iterator it;
+
+    for(int y = rowBegin; y < rowEnd; ++y) {
+        for(it = offsets.begin(); it != offsets.end(); ++it) {
+            const int px = it->dx, py = y + it->dy;
+            if(px >= 0 && px < width && py >= 0 && py < height) {
+                window.add(in[((py - inRow) * width + px) * stride]);
+            }
+        }
+        T* outLine = out + (y - outRow) * width * stride;
+        for(int x = 0; ; ++x) {
+            if(window.count() > 0) {
+                outLine[x * stride] = window.at(rankOf(percentile, window.count()));
+            }
+            else {
+                outLine[x * stride] = in[((y - inRow) * width + x) * stride];
+            }
+            if(x + 1 >= width) break;
+            for(it = leaving.begin(); it != leaving.end(); ++it) {
+                const int px = x + it->dx, py = y + it->dy;
+                if(px >= 0 && px < width && py >= 0 && py < height) {
+                    window.remove(in[((py - inRow) * width + px) * stride]);
+                }
+            }
+            for(it = entering.begin(); it != entering.end(); ++it) {
+                const int px = x + 1 + it->dx, py = y + it->dy;
+                if(px >= 0 && px < width && py >= 0 && py < height) {
+                    window.add(in[((py - inRow) * width + px) * stride]);
+                }
+            }
+        }
+        // empty the window for the next row
+        for(it = offsets.begin(); it != offsets.end(); ++it) {
+            const int px = width - 1 + it->dx, py = y + it->dy;
+            if(px >= 0 && px < width && py >= 0 && py < height) {
+                window.remove(in[((py - inRow) * width + px) * stride]);
+            }
+        }
+    }
+}
+
+template<typename D>
+void RankFilter::filterRows(const imagein::Image_t<D>* src, imagein::Image_t<D>* dst, unsigned int c,
+                            const Mask& mask, double percentile, int rowBegin, int rowEnd) {
+    const int width = src->getWidth();
+    const int height = src->getHeight();
+    const int stride = src->getNbChannels();
+    if(rowBegin >= rowEnd || width == 0) return;
+
+    // rows of the source involved in the filtering of [rowBegin, rowEnd[
+    const int first = std::max(0, rowBegin + mask.top());
+    const int last = std::min(height, rowEnd + mask.bottom());
+    const int n = (last - first) * width;
+
+    // each value is replaced by its rank among the distinct values of these rows
+    std::vector<D> values(n);
+    const D* in = src->begin() + first * width * stride + c;
+    for(int i = 0; i < n; ++i) {
+        values[i] = in[i * stride];
+    }
+    std::vector<D> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::vector<uint32_t> ranks(n);
+    for(int i = 0; i < n; ++i) {
+        ranks[i] = std::lower_bound(sorted.begin(), sorted.end(), values[i]) - sorted.begin();
+    }
+
+    std::vector<uint32_t> result((rowEnd - rowBegin) * width);
+    IndexedWindow window(sorted.size());
+    slide(&ranks[0], first, &result[0], rowBegin, width, height, 1, mask, percentile, rowBegin, rowEnd, window);
+
+    D* out = dst->begin() + rowBegin * width * stride + c;
+    for(unsigned int i = 0; i < result.size(); ++i) {
+        out[i * stride] = sorted[result[i]];
+    }
+}
+
+namespace RankFilter {
+    template<>
+    inline void filterRows<uint8_t>(const imagein::Image_t<uint8_t>* src, imagein::Image_t<uint8_t>* dst, unsigned int c,
+                                    const Mask& mask, double percentile, int rowBegin, int rowEnd) {
+        HistogramWindow window;
+        slide(src->begin() + c, 0, dst->begin() + c, 0, src->getWidth(), src->getHeight(), src->getNbChannels(),
+              mask, percentile, rowBegin, rowEnd, window);
+    }
+}
+
+template<typename D>
+void RankFilter::filter(const imagein::Image_t<D>* src, imagein::Image_t<D>* dst, const Mask& mask, double percentile) {
+    if(mask.size() == 0) {
+        throw "Error in RankFilter::filter:\nempty mask";
+    }
+    // a band should be large compared to the mask so that the overlap stays cheap
+    const int grain = std::max(16, 2 * (mask.bottom() - mask.top()));
+    Parallel::forBands(0, src->getHeight(), [&](int rowBegin, int rowEnd) {
+        for(unsigned int c = 0; c < src->getNbChannels(); ++c) {
+            filterRows(src, dst, c, mask, percentile, rowBegin, rowEnd);
+        }
+    }, grain);
+}
+
+template<typename D>
+imagein::Image_t<D>* RankFilter::filter(const imagein::Image_t<D>* src, const Mask& mask, double percentile) {
+    imagein::Image_t<D>* dst = new imagein::Image_t<D>(src->getWidth(), src->getHeight(), src->getNbChannels());
+    filter(src, dst, mask, percentile);
+    return dst;
+}
+
+#endif // RANKFILTER_H
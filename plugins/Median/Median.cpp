@@ -29,12 +29,9 @@
 #include "ImgParam.h"
 #include "IntParam.h"
 #include "PlugOperation.h"
+#include "RankFilter.h"
 
-#include <cstring>
-#include <cstdio>
-#include <cmath>
-#include <vector>
-#include <algorithm>
+#include <sstream>
 
 using namespace std;
 using namespace imagein;
@@ -44,44 +41,10 @@ class MedianCroix : public PlugOperation {
     MedianCroix() : PlugOperation("MedianCroix") {
         addParam(CurrentImg(), &MedianCroix::img);
         addParam(IntParam("Taille",1,30,3),&MedianCroix::wSide);
+        addParam(IntParam("Rang (%)",0,100,50),&MedianCroix::percentile);
     }
     void operation() {
-        Image *outputImage = new Image(img);
-        unsigned int histo[256];
-        unsigned int imageWidth = img.getWidth();
-        unsigned int imageHeight = img.getHeight();
-        unsigned int nbChannels = img.getNbChannels();
-        int iStart, iStop, jStart, jStop;
-
-   // parcours des composantes de couleur
-    for (int c=0;c<nbChannels;c++){
-
-        // parcours de l'image
-        for (int x=0;x<imageWidth;x++){
-            for(int y=0;y<imageHeight;y++){
-                    //parcours de la fentre du filtre
-
-                    x-wSide/2 < 0 ? iStart = 0 : iStart = x-wSide/2;
-                    x+wSide/2 > imageWidth-1 ? iStop = imageWidth : iStop = x+wSide/2+1;
-                    y-wSide/2 < 0 ? jStart = 0 : jStart = y-wSide/2;
-                    y+wSide/2 > imageHeight-1 ? jStop = imageHeight : jStop = y+wSide/2+1;
-
-
-                    for(int i=iStart; i< iStop ; i++){
-                        for(int j=jStart;j<jStop;j++){
-                            //remplissage de la fentre du filtre
-                            if (i==x || j==y)window.push_back(img.getPixelAt(i,j,c));
-
-                        }//j
-                    }//i
-
-                size_t size = window.size();
-                sort(window.begin(), window.begin()+size);
-                outputImage->setPixelAt(x, y, c, window[size/2]);
-                window.clear();
-            }//y
-        }//x
-    }//c
+        Image *outputImage = RankFilter::filter(&img, RankFilter::Mask::cross(wSide), percentile);
 
         //conversion de la taille de la fentre en string pour l'affichage de l'image rsultat
         string str;
@@ -94,7 +57,7 @@ class MedianCroix : public PlugOperation {
   private:
     Image img;
     int wSide;//largeur de la fentre
-    vector<int> window;
+    int percentile;//rang du filtre, 50 pour le median
 };
 
 class MedianCarre : public PlugOperation {
@@ -102,44 +65,11 @@ class MedianCarre : public PlugOperation {
     MedianCarre() : PlugOperation("MedianCarre") {
         addParam(CurrentImg(), &MedianCarre::img);
         addParam(IntParam("Taille",1,30,3),&MedianCarre::wSide);
+        addParam(IntParam("Rang (%)",0,100,50),&MedianCarre::percentile);
     }
 
     void operation() {
-        Image *outputImage = new Image(img);
-        unsigned int histo[256];
-        unsigned int imageWidth = img.getWidth();
-        unsigned int imageHeight = img.getHeight();
-        unsigned int nbChannels = img.getNbChannels();
-        int iStart, iStop, jStart, jStop;
-        int i,j;
-
-       // parcours des composantes de couleur
-    for (int c=0;c<nbChannels;c++){
-
-        // parcours de l'image
-        for (int x=0;x<imageWidth;x++){
-            for(int y=0;y<imageHeight;y++){
-                    //parcours de la fentre du filtre
-
-                    x-wSide/2 < 0 ? iStart = 0 : iStart = x-wSide/2;
-                    x+wSide/2 > imageWidth-1 ? iStop = imageWidth : iStop = x+wSide/2+1;
-                    y-wSide/2 < 0 ? jStart = 0 : jStart = y-wSide/2;
-                    y+wSide/2 > imageHeight-1 ? jStop = imageHeight : jStop = y+wSide/2+1;
-
-                    for(i=iStart; i< iStop ; i++){
-                        for(j=jStart;j<jStop;j++){
-                            //remplissage de la fentre du filtre
-                            window.push_back(img.getPixelAt(i,j,c));
-                        }//j
-                    }//i
-
-                size_t size = window.size();
-                sort(window.begin(), window.begin()+size);
-                outputImage->setPixelAt(x, y, c, window[size/2]);
-                window.clear();
-            }//y
-        }//x
-    }//c
+        Image *outputImage = RankFilter::filter(&img, RankFilter::Mask::square(wSide), percentile);
 
         //conversion de la taille de la fentre en string pour l'affichage de l'image rsultat
         string str;
@@ -152,7 +82,7 @@ class MedianCarre : public PlugOperation {
   private:
     Image img;
     int wSide;//largeur de la fentre
-    vector<int> window;
+    int percentile;//rang du filtre, 50 pour le median
 };
 
 extern "C" Plugin* loadPlugin() {